@@ -19,8 +19,30 @@
 #include "rzip.h"
 #include <zlib.h>
 
+#include <atomic>
+#include <thread>
+
 const u8 RZipHeader[8] = { '#', 'R', 'Z', 'I', 'P', 'v', 1, '#' };
 
+// Chunks are independent so they're compressed and uncompressed in parallel.
+// Runs f(0) ... f(count - 1) on up to one thread per core.
+template<typename F>
+static void parallelFor(size_t count, F f)
+{
+	size_t threadCount = std::min<size_t>(count, std::max(1u, std::thread::hardware_concurrency()));
+	std::atomic<size_t> next(0);
+	auto worker = [&]() {
+		for (size_t i = next++; i < count; i = next++)
+			f(i);
+	};
+	std::vector<std::thread> threads;
+	for (size_t i = 1; i < threadCount; i++)
+		threads.emplace_back(worker);
+	worker();
+	for (auto& thread : threads)
+		thread.join();
+}
+
 bool RZipFile::Open(const std::string& path, bool write)
 {
 	verify(file == nullptr);
@@ -69,6 +91,16 @@ size_t RZipFile::Read(void *data, size_t length)
 	size_t rv = 0;
 	while (rv < length)
 	{
+		if (chunkIndex == chunkSize && length - rv >= maxChunkSize)
+		{
+			// Uncompress whole chunks directly into the destination
+			size_t l = ReadChunks(p, length - rv);
+			if (l == 0)
+				break;
+			p += l;
+			rv += l;
+			continue;
+		}
 		if (chunkIndex == chunkSize)
 		{
 			chunkSize = 0;
@@ -93,7 +125,7 @@ size_t RZipFile::Read(void *data, size_t length)
 			delete [] zipped;
 			chunkSize = (u32)tl;
 		}
-		u32 l = std::min(chunkSize - chunkIndex, (u32)length);
+		u32 l = (u32)std::min<size_t>(chunkSize - chunkIndex, length - rv);
 		memcpy(p, chunk + chunkIndex, l);
 		p += l;
 		chunkIndex += l;
@@ -103,6 +135,47 @@ size_t RZipFile::Read(void *data, size_t length)
 	return rv;
 }
 
+size_t RZipFile::ReadChunks(u8 *dst, size_t length)
+{
+	std::vector<std::vector<u8>> zipped;
+	while (zipped.size() < length / maxChunkSize)
+	{
+		u32 zippedSize;
+		if (std::fread(&zippedSize, sizeof(zippedSize), 1, file) != 1)
+			break;
+		if (zippedSize == 0)
+			continue;
+		zipped.emplace_back(zippedSize);
+		if (std::fread(zipped.back().data(), zippedSize, 1, file) != 1)
+		{
+			zipped.pop_back();
+			break;
+		}
+	}
+	std::vector<uLongf> sizes(zipped.size());
+	std::vector<u8> ok(zipped.size());
+	parallelFor(zipped.size(), [&](size_t i) {
+		sizes[i] = maxChunkSize;
+		ok[i] = uncompress(dst + i * maxChunkSize, &sizes[i], zipped[i].data(), zipped[i].size()) == Z_OK;
+	});
+	// Only the last chunk of a file should be partial but move the data around if not
+	size_t rv = 0;
+	for (size_t i = 0; i < zipped.size(); i++)
+	{
+		if (!ok[i])
+		{
+			// Following chunks have been consumed already
+			std::fseek(file, 0, SEEK_END);
+			break;
+		}
+		if (rv != i * maxChunkSize)
+			memmove(dst + rv, dst + i * maxChunkSize, sizes[i]);
+		rv += sizes[i];
+	}
+
+	return rv;
+}
+
 size_t RZipFile::Write(const void *data, size_t length)
 {
 	verify(file != nullptr);
@@ -116,29 +189,33 @@ size_t RZipFile::Write(const void *data, size_t length)
 	const u8 *p = (const u8 *)data;
 	// compression output buffer must be 0.1% larger + 12 bytes
 	uLongf maxZippedSize = maxChunkSize + maxChunkSize / 1000 + 12;
-	u8 *zipped = new u8[maxZippedSize];
+	size_t chunkCount = (length + maxChunkSize - 1) / maxChunkSize;
+	std::vector<std::vector<u8>> zipped(chunkCount);
+	std::vector<int> rcs(chunkCount);
+	parallelFor(chunkCount, [&](size_t i) {
+		zipped[i].resize(maxZippedSize);
+		uLongf zippedSize = maxZippedSize;
+		uLongf uncompressedSize = std::min(maxChunkSize, (u32)(length - i * maxChunkSize));
+		rcs[i] = compress(zipped[i].data(), &zippedSize, p + i * maxChunkSize, uncompressedSize);
+		zipped[i].resize(zippedSize);
+	});
 	size_t rv = 0;
-	while (rv < length)
+	for (size_t i = 0; i < chunkCount; i++)
 	{
-		uLongf zippedSize = maxZippedSize;
-		uLongf uncompressedSize = std::min(maxChunkSize, (u32)(length - rv));
-		u32 rc = compress(zipped, &zippedSize, p, uncompressedSize);
-		if (rc != Z_OK)
+		if (rcs[i] != Z_OK)
 		{
-			WARN_LOG(SAVESTATE, "Compression error: %d", rc);
+			WARN_LOG(SAVESTATE, "Compression error: %d", rcs[i]);
 			break;
 		}
-		u32 sz = (u32)zippedSize;
+		u32 sz = (u32)zipped[i].size();
 		if (std::fwrite(&sz, sizeof(sz), 1, file) != 1
-			|| std::fwrite(zipped, zippedSize, 1, file) != 1)
+			|| std::fwrite(zipped[i].data(), sz, 1, file) != 1)
 		{
 			rv = 0;
 			break;
 		}
-		p += uncompressedSize;
-		rv += uncompressedSize;
+		rv += std::min(maxChunkSize, (u32)(length - rv));
 	}
-	delete [] zipped;
 	
 	return rv;
 }
@@ -34,6 +34,8 @@ public:
 	size_t Write(const void *data, size_t length);
 
 private:
+	size_t ReadChunks(u8 *dst, size_t length);
+
 	FILE *file = nullptr;
 	size_t size = 0;
 	u32 maxChunkSize = 0;
@@ -26,6 +26,11 @@ Option<bool> DynarecEnabled("Dynarec.Enabled", true);
 Option<bool> DynarecIdleSkip("Dynarec.idleskip", true);
 Option<bool> DynarecSafeMode("Dynarec.safe-mode");
 Option<bool> DisableVmem32("Dynarec.DisableVmem32");
+Option<bool> DynarecBlockCache("Dynarec.BlockCache");
+Option<bool> DynarecSuperblocks("Dynarec.Superblocks", true);
+Option<bool> DynarecAsyncCompile("Dynarec.AsyncCompile");
+Option<bool> DynarecMmuTlb("Dynarec.MmuTlb");
+Option<bool, false> DynarecPerfMap("Dynarec.PerfMap");
 
 // General
 
@@ -36,11 +41,17 @@ Option<int> Language("Dreamcast.Language", 1);		// English
 Option<bool> FullMMU("Dreamcast.FullMMU");
 Option<bool> ForceWindowsCE("Dreamcast.ForceWindowsCE");
 Option<bool> AutoSavestate("Dreamcast.AutoSavestate");
+Option<bool> RewindEnabled("Dreamcast.Rewind");
+Option<int> RewindDepth("Dreamcast.RewindDepth", 60);
+Option<int> RewindInterval("Dreamcast.RewindInterval", 30);
+Option<int> ChdCacheSize("Dreamcast.ChdCacheSize", 16);
 
 // Sound
 
 Option<bool> DSPEnabled("aica.DSPEnabled", false);
 Option<bool> DisableSound("aica.NoSound");
+Option<bool> ThreadedAica("aica.Threaded", false);
+Option<bool> DynamicRateControl("aica.DynamicRateControl", false);
 #if HOST_CPU == CPU_ARM
 Option<int> AudioBufferSize("aica.BufferSize", 5644);	// 128 ms
 #else
@@ -289,6 +289,11 @@ extern Option<bool> DynarecEnabled;
 extern Option<bool> DynarecIdleSkip;
 extern Option<bool> DynarecSafeMode;
 extern Option<bool> DisableVmem32;
+extern Option<bool> DynarecBlockCache;
+extern Option<bool> DynarecSuperblocks;
+extern Option<bool> DynarecAsyncCompile;
+extern Option<bool> DynarecMmuTlb;
+extern Option<bool, false> DynarecPerfMap;
 
 // General
 
@@ -299,12 +304,18 @@ extern Option<int> Language;	// 0 -> JP, 1 -> EN, 2 -> DE, 3 -> FR, 4 -> SP, 5 -
 extern Option<bool> FullMMU;
 extern Option<bool> ForceWindowsCE;
 extern Option<bool> AutoSavestate;
+extern Option<bool> RewindEnabled;
+extern Option<int> RewindDepth;		// number of snapshots
+extern Option<int> RewindInterval;	// frames between snapshots
+extern Option<int> ChdCacheSize;	// decompressed CHD hunks
 
 // Sound
 
 constexpr ConstOption<bool, true> LimitFPS;
 extern Option<bool> DSPEnabled;
 extern Option<bool> DisableSound;
+extern Option<bool> ThreadedAica;
+extern Option<bool> DynamicRateControl;
 extern Option<int> AudioBufferSize;	//In samples ,*4 for bytes
 extern Option<bool> AutoLatency;
 
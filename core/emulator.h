@@ -41,6 +41,7 @@ void dc_resume();
 void dc_step();
 void dc_savestate();
 void dc_loadstate();
+void dc_rewind();
 void dc_load_game(const char *path);
 bool dc_is_load_done();
 void dc_cancel_load();
@@ -5,8 +5,15 @@
 #include "hw/holly/holly_intc.h"
 #include "hw/holly/sb.h"
 #include "hw/sh4/sh4_sched.h"
+#include "hw/sh4/sh4_interpreter.h"
 #include "hw/arm7/arm7.h"
 #include "hw/arm7/arm_mem.h"
+#include "cfg/option.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 #define SH4_IRQ_BIT (1 << (holly_SPU_IRQ & 31))
 
@@ -65,9 +72,18 @@ static void update_arm_interrupts()
 	libARM_InterruptChange(p_ints,Lval);
 }
 
+// Set when the sound thread changes the sh4 interrupt state. Applied by the emulation thread when the batch is done.
+static std::atomic<bool> sh4IntsChanged;
+static thread_local bool onSoundThread;
+
 //sh4 side
 static void UpdateSh4Ints()
 {
+	if (onSoundThread)
+	{
+		sh4IntsChanged = true;
+		return;
+	}
 	u32 p_ints = MCIEB->full & MCIPD->full;
 	if (p_ints)
 	{
@@ -86,15 +102,121 @@ AicaTimer timers[3];
 int aica_schid = -1;
 const int AICA_TICK = 145125;	// 44.1 KHz / 32
 
-static int AicaUpdate(int tag, int c, int j)
+static void AicaRunBatch()
 {
 	aicaarm::run(32);
 	if (!settings.aica.NoBatch)
 		AICA_Sample32();
+}
+
+// Threaded mode: each batch of 32 samples runs on the sound thread while the sh4 keeps going.
+// The emulation thread waits for the current batch before touching any aica state.
+static std::mutex soundMutex;
+static std::condition_variable soundWakeup;
+static std::condition_variable soundIdle;
+static std::atomic<bool> batchPending;
+static std::atomic<bool> soundRunning;
+static int aica_int_schid = -1;
+static std::thread soundThread;
+
+static void soundThreadLoop()
+{
+	onSoundThread = true;
+	std::unique_lock<std::mutex> lock(soundMutex);
+	while (true)
+	{
+		soundWakeup.wait(lock, []() { return !soundRunning || batchPending; });
+		if (!soundRunning)
+			break;
+		lock.unlock();
+
+		AicaRunBatch();
+
+		lock.lock();
+		batchPending.store(false, std::memory_order_release);
+		soundIdle.notify_all();
+	}
+}
+
+void libAICA_Sync()
+{
+	if (onSoundThread)
+		return;
+	if (batchPending.load(std::memory_order_acquire))
+	{
+		std::unique_lock<std::mutex> lock(soundMutex);
+		soundIdle.wait(lock, []() { return !batchPending; });
+	}
+	if (sh4IntsChanged)
+	{
+		sh4IntsChanged = false;
+		UpdateSh4Ints();
+	}
+}
+
+static void startSoundThread()
+{
+	std::lock_guard<std::mutex> lock(soundMutex);
+	if (soundRunning)
+		return;
+	soundRunning = true;
+	soundThread = std::thread(soundThreadLoop);
+}
+
+static void stopSoundThread()
+{
+	if (!soundRunning)
+		return;
+	libAICA_Sync();
+	{
+		std::lock_guard<std::mutex> lock(soundMutex);
+		if (!soundRunning)
+			return;
+		soundRunning = false;
+	}
+	soundWakeup.notify_one();
+	soundThread.join();
+}
+
+// Stops the thread if the process exits without calling libAICA_Term()
+static struct SoundThreadGuard {
+	~SoundThreadGuard() {
+		stopSoundThread();
+	}
+} soundThreadGuard;
+
+static int AicaUpdate(int tag, int c, int j)
+{
+	if (config::ThreadedAica)
+	{
+		libAICA_Sync();
+		startSoundThread();
+		{
+			std::lock_guard<std::mutex> lock(soundMutex);
+			batchPending = true;
+		}
+		soundWakeup.notify_one();
+		sh4_sched_request(aica_int_schid, SH4_TIMESLICE);
+	}
+	else
+	{
+		stopSoundThread();
+		AicaRunBatch();
+	}
 
 	return AICA_TICK;
 }
 
+// Threaded mode: checks every sh4 timeslice if the batch is done to raise its interrupts
+static int AicaIntUpdate(int tag, int c, int j)
+{
+	if (batchPending.load(std::memory_order_acquire))
+		return SH4_TIMESLICE;
+	libAICA_Sync();
+
+	return 0;
+}
+
 //Mainloop
 
 void libAICA_TimeStep()
@@ -261,6 +383,7 @@ s32 libAICA_Init()
 	{
 		aica_schid = sh4_sched_register(0, &AicaUpdate);
 		sh4_sched_request(aica_schid, AICA_TICK);
+		aica_int_schid = sh4_sched_register(0, &AicaIntUpdate);
 	}
 
 	return 0;
@@ -268,6 +391,7 @@ s32 libAICA_Init()
 
 void libAICA_Reset(bool hard)
 {
+	libAICA_Sync();
 	if (hard)
 	{
 		init_mem();
@@ -280,6 +404,7 @@ void libAICA_Reset(bool hard)
 
 void libAICA_Term()
 {
+	stopSoundThread();
 	sgc_Term();
 	term_mem();
 }
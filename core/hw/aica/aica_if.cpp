@@ -84,6 +84,7 @@ void WriteMem_aica_rtc(u32 addr,u32 data,u32 sz)
 
 u32 ReadMem_aica_reg(u32 addr,u32 sz)
 {
+	libAICA_Sync();
 	addr&=0x7FFF;
 	if (sz==1)
 	{
@@ -121,6 +122,7 @@ static void ArmSetRST()
 
 void WriteMem_aica_reg(u32 addr,u32 data,u32 sz)
 {
+	libAICA_Sync();
 	addr&=0x7FFF;
 
 	if (sz==1)
@@ -263,6 +265,7 @@ void Write_DmaStart(u32 addr, u32 data)
 
 	if (!(data & 1) || !(enableReg & 1))
 		return;
+	libAICA_Sync();
 	u32 src = sourceReg;
 	u32 dst = destReg;
 	u32 len = lenReg & 0x7FFFFFFF;
@@ -365,6 +368,7 @@ static void Write_SB_ADST(u32 addr, u32 data)
 				return;
 			}
 
+			libAICA_Sync();
 			if ((SB_ADDIR&1)==1)
 			{
 				//swap direction
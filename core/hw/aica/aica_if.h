@@ -22,3 +22,6 @@ s32 libAICA_Init();
 void libAICA_Reset(bool hard);
 void libAICA_Term();
 void libAICA_TimeStep();
+// Waits until the sound thread is done with the current batch. Must be called before
+// the emulation thread accesses the aica registers or state.
+void libAICA_Sync();
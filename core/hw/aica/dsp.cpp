@@ -1,4 +1,7 @@
 #include "dsp.h"
+#include "aica.h"
+#include "profiler/perf_jit.h"
+#include <xxhash.h>
 
 /*
 	DSP rec_v1
@@ -95,6 +98,69 @@ void DecodeInst(const u32 *IPtr, _INST *i)
 
 #if FEAT_DSPREC != DYNAREC_NONE
 
+// The compiled code only depends on MPRO and the ring buffer settings. COEF and MADRS are read at runtime.
+struct CachedProgram
+{
+	bool valid;
+	u64 hash;
+	u32 RBL;
+	u32 RBP;
+	u64 lastUse;
+	u32 MPRO[128 * 4];
+};
+static CachedProgram programCache[DSP_CACHE_SLOTS];
+static u64 useCounter;
+static DspCacheStats cacheStats;
+
+const DspCacheStats& dsp_GetCacheStats()
+{
+	return cacheStats;
+}
+
+static bool isProgramEmpty()
+{
+	for (int i = 127 * 4; i >= 0; i -= 4)
+	{
+		const u32 *IPtr = DSPData->MPRO + i;
+		if (IPtr[0] != 0 || IPtr[1] != 0 || IPtr[2] != 0 || IPtr[3] != 0)
+			return false;
+	}
+	return true;
+}
+
+static void loadProgram()
+{
+	dsp.Stopped = isProgramEmpty();
+	if (dsp.Stopped)
+		return;
+	static_assert(sizeof(DSPData->MPRO) == sizeof(CachedProgram::MPRO), "MPRO size mismatch");
+	const u64 hash = XXH64(DSPData->MPRO, sizeof(DSPData->MPRO), 0);
+	int lru = 0;
+	for (int i = 0; i < DSP_CACHE_SLOTS; i++)
+	{
+		CachedProgram& program = programCache[i];
+		if (program.valid && program.hash == hash && program.RBL == dsp.RBL && program.RBP == dsp.RBP
+				&& !memcmp(program.MPRO, DSPData->MPRO, sizeof(program.MPRO)))
+		{
+			program.lastUse = ++useCounter;
+			cacheStats.hits++;
+			dsp_rec_select(i);
+			return;
+		}
+		if (!program.valid || (programCache[lru].valid && program.lastUse < programCache[lru].lastUse))
+			lru = i;
+	}
+	CachedProgram& program = programCache[lru];
+	dsp_rec_compile(lru);
+	cacheStats.compiles++;
+	program.valid = true;
+	program.hash = hash;
+	program.RBL = dsp.RBL;
+	program.RBP = dsp.RBP;
+	program.lastUse = ++useCounter;
+	memcpy(program.MPRO, DSPData->MPRO, sizeof(program.MPRO));
+}
+
 void dsp_init()
 {
 	memset(&dsp, 0, sizeof(dsp));
@@ -102,6 +168,8 @@ void dsp_init()
 	dsp.RBP = 0;
 	dsp.regs.MDEC_CT = 1;
 	dsp.dyndirty = true;
+	for (CachedProgram& program : programCache)
+		program.valid = false;
 
 	dsp_rec_init();
 }
@@ -111,13 +179,23 @@ void dsp_step()
 	if (dsp.dyndirty)
 	{
 		dsp.dyndirty = false;
-		dsp_recompile();
+		loadProgram();
 	}
 	if (dsp.Stopped)
 		return;
 	dsp_rec_step();
 }
 
+void dsp_rec_loaded(const void *code, u32 size)
+{
+	if (perfjit::enabled())
+	{
+		char name[32];
+		sprintf(name, "dsp:h:%08X", perfjit::guestHash(DSPData->MPRO, sizeof(DSPData->MPRO)));
+		perfjit::codeLoaded(code, size, name);
+	}
+}
+
 void dsp_writenmem(u32 addr)
 {
 	if (addr >= 0x3400 && addr < 0x3C00)
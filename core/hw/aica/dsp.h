@@ -4,7 +4,7 @@
 struct dsp_t
 {
 	//Dynarec
-	u8 DynCode[4096*8];	//32 kb, 8 pages
+	u8 DynCode[4096*8];	// no longer used, kept for savestate compatibility
 
 	//buffered DSP state
 	//24 bit wide
@@ -92,9 +92,18 @@ void dsp_term();
 void dsp_step();
 void dsp_writenmem(u32 addr);
 
+// Compiled programs are cached so that games switching between a few effects don't recompile each time
+constexpr int DSP_CACHE_SLOTS = 8;
+constexpr u32 DSP_CODE_SIZE = 32 * 1024;
+
 void dsp_rec_init();
 void dsp_rec_step();
-void dsp_recompile();
+// Compiles the current program into the given cache slot and makes it current
+void dsp_rec_compile(int slot);
+// Makes the program in the given cache slot current
+void dsp_rec_select(int slot);
+// Called by the backends once the program has been compiled
+void dsp_rec_loaded(const void *code, u32 size);
 
 struct _INST
 {
@@ -127,6 +136,13 @@ struct _INST
 	bool NXADR; //MRQ set
 };
 
+struct DspCacheStats
+{
+	u64 compiles;
+	u64 hits;				// program changes finding compiled code
+};
+const DspCacheStats& dsp_GetCacheStats();
+
 void DecodeInst(const u32 *IPtr, _INST *i);
 u16 DYNACALL PACK(s32 val);
 s32 DYNACALL UNPACK(u16 val);
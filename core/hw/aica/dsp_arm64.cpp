@@ -28,6 +28,8 @@
 #include <aarch64/macro-assembler-aarch64.h>
 using namespace vixl::aarch64;
 
+alignas(4096) static u8 CodeBuffer[DSP_CACHE_SLOTS * DSP_CODE_SIZE];
+static u8 *pCodeSlots;
 static u8 *pCodeBuffer;
 
 class DSPAssembler : public MacroAssembler
@@ -434,26 +436,22 @@ private:
 	Literal<u8*> *aica_ram_lit;
 };
 
-void dsp_recompile()
+void dsp_rec_compile(int slot)
 {
-	dsp.Stopped = true;
-	for (int i = 127; i >= 0; --i)
-	{
-		u32 *IPtr = DSPData->MPRO + i * 4;
-
-		if (IPtr[0] != 0 || IPtr[1] != 0 || IPtr[2 ]!= 0 || IPtr[3] != 0)
-		{
-			dsp.Stopped = false;
-			break;
-		}
-	}
-	DSPAssembler assembler(pCodeBuffer, sizeof(dsp.DynCode));
+	pCodeBuffer = &pCodeSlots[slot * DSP_CODE_SIZE];
+	DSPAssembler assembler(pCodeBuffer, DSP_CODE_SIZE);
 	assembler.Compile(&dsp);
+	dsp_rec_loaded(pCodeBuffer, assembler.GetBuffer()->GetSizeInBytes());
+}
+
+void dsp_rec_select(int slot)
+{
+	pCodeBuffer = &pCodeSlots[slot * DSP_CODE_SIZE];
 }
 
 void dsp_rec_init()
 {
-	if (!vmem_platform_prepare_jit_block(dsp.DynCode, sizeof(dsp.DynCode), (void**)&pCodeBuffer))
+	if (!vmem_platform_prepare_jit_block(CodeBuffer, sizeof(CodeBuffer), (void**)&pCodeSlots))
 		die("mprotect failed in arm64 dsp");
 }
 
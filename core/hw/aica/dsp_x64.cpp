@@ -31,7 +31,7 @@
 #define CC_RW2RX(ptr) (ptr)
 #define CC_RX2RW(ptr) (ptr)
 
-alignas(4096) static u8 CodeBuffer[32 * 1024]
+alignas(4096) static u8 CodeBuffer[DSP_CACHE_SLOTS * DSP_CODE_SIZE]
 #if defined(_WIN32)
 	;
 #elif defined(__unix__)
@@ -41,6 +41,7 @@ alignas(4096) static u8 CodeBuffer[32 * 1024]
 #else
 	#error CodeBuffer code section unknown
 #endif
+static u8 *pCodeSlots;
 static u8 *pCodeBuffer;
 
 class X64DSPAssembler : public Xbyak::CodeGenerator
@@ -407,26 +408,22 @@ private:
 	struct dsp_t *DSP = nullptr;
 };
 
-void dsp_recompile()
+void dsp_rec_compile(int slot)
 {
-	dsp.Stopped = true;
-	for (int i = 127; i >= 0; --i)
-	{
-		u32 *IPtr = DSPData->MPRO + i * 4;
-
-		if (IPtr[0] != 0 || IPtr[1] != 0 || IPtr[2 ]!= 0 || IPtr[3] != 0)
-		{
-			dsp.Stopped = false;
-			break;
-		}
-	}
-	X64DSPAssembler assembler(pCodeBuffer, sizeof(CodeBuffer));
+	pCodeBuffer = &pCodeSlots[slot * DSP_CODE_SIZE];
+	X64DSPAssembler assembler(pCodeBuffer, DSP_CODE_SIZE);
 	assembler.Compile(&dsp);
+	dsp_rec_loaded(pCodeBuffer, assembler.getSize());
+}
+
+void dsp_rec_select(int slot)
+{
+	pCodeBuffer = &pCodeSlots[slot * DSP_CODE_SIZE];
 }
 
 void dsp_rec_init()
 {
-	if (!vmem_platform_prepare_jit_block(CodeBuffer, sizeof(CodeBuffer), (void**)&pCodeBuffer))
+	if (!vmem_platform_prepare_jit_block(CodeBuffer, sizeof(CodeBuffer), (void**)&pCodeSlots))
 		die("mprotect failed in x64 dsp");
 }
 
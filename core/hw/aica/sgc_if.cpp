@@ -23,6 +23,7 @@
 #include "aica_if.h"
 #include "aica_mem.h"
 #include "dsp.h"
+#include "sgc_mix.h"
 #include "oslib/audiostream.h"
 #include "hw/gdrom/gdrom_if.h"
 #include "cfg/option.h"
@@ -456,58 +457,78 @@ struct ChannelEx
 
 		return rv;
 	}
-	__forceinline bool Step(SampleType& oLeft, SampleType& oRight, SampleType& oDsp)
+	__forceinline SampleType FilteredSample()
 	{
-		if (!enabled)
+		SampleType sample = InterpolateSample();
+
+		// Low-pass filter
+		if (FEG.active)
 		{
-			oLeft=oRight=oDsp=0;
-			return false;
+			u32 fv = FEG.GetValue();
+			s32 f = (((fv & 0xFF) | 0x100) << 4) >> ((fv >> 8) ^ 0x1F);
+			f = std::max(1, f);
+			sample = f * sample + (0x2000 - f + FEG.q) * FEG.prev1 - FEG.q * FEG.prev2;
+			sample >>= 13;
+			clip16(sample);
+			FEG.prev2 = FEG.prev1;
+			FEG.prev1 = sample;
+		}
+		return sample;
+	}
+
+	// Left, right and dsp send multipliers (xx.15) of the current sample
+	__forceinline void GetGains(s32& left, s32& right, s32& dsp)
+	{
+		//Volume & Mixer processing
+		//All attenuations are added together then applied and mixed :)
+
+		//offset is up to 511
+		//*Att is up to 511
+		//logtable handles up to 1024, anything >=255 is mute
+
+		u32 ofsatt;
+		if (ccd->VOFF == 1)
+		{
+			ofsatt = 0;
 		}
 		else
 		{
-			SampleType sample = InterpolateSample();
-
-			// Low-pass filter
-			if (FEG.active)
-			{
-				u32 fv = FEG.GetValue();
-				s32 f = (((fv & 0xFF) | 0x100) << 4) >> ((fv >> 8) ^ 0x1F);
-				f = std::max(1, f);
-				sample = f * sample + (0x2000 - f + FEG.q) * FEG.prev1 - FEG.q * FEG.prev2;
-				sample >>= 13;
-				clip16(sample);
-				FEG.prev2 = FEG.prev1;
-				FEG.prev1 = sample;
-			}
+			ofsatt = lfo.alfo + (AEG.GetValue() >> 2);
+			ofsatt = std::min(ofsatt, (u32)255); // make sure it never gets more 255 -- it can happen with some alfo/aeg combinations
+		}
+		u32 const max_att = ((16 << 4) - 1) - ofsatt;
 
-			//Volume & Mixer processing
-			//All attenuations are added together then applied and mixed :)
+		s32* logtable = ofsatt + tl_lut;
 
-			//offset is up to 511
-			//*Att is up to 511
-			//logtable handles up to 1024, anything >=255 is mute
+		left = logtable[std::min(VolMix.DLAtt, max_att)];
+		right = logtable[std::min(VolMix.DRAtt, max_att)];
+		dsp = logtable[std::min(VolMix.DSPAtt, max_att)];
+	}
 
-			u32 ofsatt;
-			if (ccd->VOFF == 1)
-			{
-				ofsatt = 0;
-			}
-			else
-			{
-				ofsatt = lfo.alfo + (AEG.GetValue() >> 2);
-				ofsatt = std::min(ofsatt, (u32)255); // make sure it never gets more 255 -- it can happen with some alfo/aeg combinations
-			}
-			u32 const max_att = ((16 << 4) - 1) - ofsatt;
-			
-			s32* logtable = ofsatt + tl_lut;
+	__forceinline void StepState()
+	{
+		StepAEG(this);
+		StepFEG(this);
+		StepStream(this);
+		lfo.Step(this);
+	}
 
-			u32 dl = std::min(VolMix.DLAtt, max_att);
-			u32 dr = std::min(VolMix.DRAtt, max_att);
-			u32 ds = std::min(VolMix.DSPAtt, max_att);
+	__forceinline bool Step(SampleType& oLeft, SampleType& oRight, SampleType& oDsp)
+	{
+		if (!enabled)
+		{
+			oLeft=oRight=oDsp=0;
+			return false;
+		}
+		else
+		{
+			SampleType sample = FilteredSample();
+			s32 gainLeft, gainRight, gainDsp;
+			GetGains(gainLeft, gainRight, gainDsp);
 
-			oLeft = FPMul(sample, logtable[dl], 15);
-			oRight = FPMul(sample, logtable[dr], 15);
-			oDsp = FPMul(sample, logtable[ds], 11);	// 20 bits
+			oLeft = FPMul(sample, gainLeft, 15);
+			oRight = FPMul(sample, gainRight, 15);
+			oDsp = FPMul(sample, gainDsp, 11);	// 20 bits
 
 			clip_verify(((s16)oLeft)==oLeft);
 			clip_verify(((s16)oRight)==oRight);
@@ -516,14 +537,41 @@ struct ChannelEx
 			clip_verify(sample*oRight>=0);
 			clip_verify((s64)sample*oDsp>=0);
 
-			StepAEG(this);
-			StepFEG(this);
-			StepStream(this);
-			lfo.Step(this);
+			StepState();
 			return true;
 		}
 	}
 
+	// Steps the channel for up to MIX_BATCH_SIZE samples, stopping when it gets disabled.
+	// The remaining samples of the batch are silent.
+	void StepBatch(ChannelBatch& batch)
+	{
+		u32 i = 0;
+		for (; i < MIX_BATCH_SIZE && enabled; i++)
+		{
+			if (FEG.active)
+			{
+				batch.s0[i] = FilteredSample();
+				batch.s1[i] = 0;
+				batch.fp[i] = 0;
+			}
+			else
+			{
+				batch.s0[i] = s0;
+				batch.s1[i] = s1;
+				batch.fp[i] = step.fp;
+			}
+			GetGains(batch.gainLeft[i], batch.gainRight[i], batch.gainDsp[i]);
+			StepState();
+		}
+		for (; i < MIX_BATCH_SIZE; i++)
+		{
+			batch.s0[i] = 0;
+			batch.s1[i] = 0;
+			batch.fp[i] = 0;
+		}
+	}
+
 	__forceinline void Step(SampleType& mixl, SampleType& mixr)
 	{
 		SampleType oLeft,oRight,oDsp;
@@ -1355,32 +1403,29 @@ void WriteCommonReg8(u32 reg,u32 data)
 s16 cdda_sector[CDDA_SIZE]={0};
 u32 cdda_index=CDDA_SIZE<<1;
 
-//no DSP for now in this version
 void AICA_Sample32()
 {
-	SampleType mxlr[64];
-	memset(mxlr,0,sizeof(mxlr));
+	alignas(16) SampleType mixlBatch[MIX_BATCH_SIZE] {};
+	alignas(16) SampleType mixrBatch[MIX_BATCH_SIZE] {};
+	// dsp inputs (MIXS) of each sample
+	alignas(16) SampleType mixsBatch[16][MIX_BATCH_SIZE];
+	ChannelBatch batch;
+
+	const bool dspEnabled = config::DSPEnabled;
+	if (dspEnabled)
+		memset(mixsBatch, 0, sizeof(mixsBatch));
 
 	//Generate 32 samples for each channel, before moving to next channel
 	//much more cache efficient !
-	u32 sg=0;
 	for (int ch = 0; ch < 64; ch++)
 	{
-		for (int i=0;i<32;i++)
-		{
-			SampleType oLeft,oRight,oDsp;
-			//stop working on this channel if its turned off ...
-			if (!Chans[ch].Step(oLeft, oRight, oDsp))
-				break;
-
-			sg++;
-
-			if (oLeft + oRight == 0)
-				oLeft = oRight = oDsp;
-
-			mxlr[i*2+0] += oLeft;
-			mxlr[i*2+1] += oRight;
-		}
+		if (!Chans[ch].enabled)
+			continue;
+		Chans[ch].StepBatch(batch);
+		if (dspEnabled)
+			mixBatch<true>(batch, mixlBatch, mixrBatch, mixsBatch[Chans[ch].VolMix.DSPOut - dsp.MIXS]);
+		else
+			mixBatch<false>(batch, mixlBatch, mixrBatch, nullptr);
 	}
 	//OK , generated all Channels  , now DSP/ect + final mix ;p
 	//CDDA EXTS input
@@ -1389,8 +1434,8 @@ void AICA_Sample32()
 	{
 		SampleType mixl,mixr;
 
-		mixl=mxlr[i*2+0];
-		mixr=mxlr[i*2+1];
+		mixl=mixlBatch[i];
+		mixr=mixrBatch[i];
 
 		if (cdda_index>=CDDA_SIZE)
 		{
@@ -1408,18 +1453,18 @@ void AICA_Sample32()
 		VOLPAN(EXTS0L, dsp_out_vol[16].EFSDL, dsp_out_vol[16].EFPAN, mixl, mixr);
 		VOLPAN(EXTS0R, dsp_out_vol[17].EFSDL, dsp_out_vol[17].EFPAN, mixl, mixr);
 
-		/*
-		no dsp for now -- needs special handling of oDSP for ch paraller version ...
-		if (config::DSPEnabled)
+		DSPData->EXTS[0] = EXTS0L;
+		DSPData->EXTS[1] = EXTS0R;
+
+		if (dspEnabled)
 		{
+			for (int j = 0; j < 16; j++)
+				dsp.MIXS[j] = mixsBatch[j][i];
 			dsp_step();
 
-			for (int i=0;i<16;i++)
-			{
-				VOLPAN( (*(s16*)&DSPData->EFREG[i]) ,dsp_out_vol[i].EFSDL,dsp_out_vol[i].EFPAN,mixl,mixr);
-			}
+			for (int j = 0; j < 16; j++)
+				VOLPAN(*(s16*)&DSPData->EFREG[j], dsp_out_vol[j].EFSDL, dsp_out_vol[j].EFPAN, mixl, mixr);
 		}
-		*/
 
 		//Mono !
 		if (CommonData->Mono)
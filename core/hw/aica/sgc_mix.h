@@ -0,0 +1,160 @@
+/*
+	Copyright 2026 Flycast contributors
+
+	This file is part of Flycast.
+
+    Flycast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    Flycast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Flycast.  If not, see <https://www.gnu.org/licenses/>.
+*/
+// Batched channel mixing.
+// AICA_Sample32 steps each channel for 32 samples and records the stream and attenuation
+// state of every sample in structure-of-arrays form. Interpolation, volume/pan attenuation, dsp sends
+// and accumulation are then done on several samples at once.
+#pragma once
+#include "types.h"
+
+#if HOST_CPU == CPU_X86 || HOST_CPU == CPU_X64
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__) || defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+constexpr u32 MIX_BATCH_SIZE = 32;
+
+struct alignas(16) ChannelBatch
+{
+	// Interpolation inputs. Filtered samples are stored in s0 with fp == 0
+	s32 s0[MIX_BATCH_SIZE];
+	s32 s1[MIX_BATCH_SIZE];
+	s32 fp[MIX_BATCH_SIZE];
+	// tl_lut multipliers, xx.15
+	s32 gainLeft[MIX_BATCH_SIZE];
+	s32 gainRight[MIX_BATCH_SIZE];
+	s32 gainDsp[MIX_BATCH_SIZE];
+};
+
+// Reference implementation.
+// With the dsp enabled, the dsp sends are added to mixs. Otherwise channels that are only sent
+// to the dsp are mixed directly.
+template<bool DspEnabled>
+static inline void mixBatchScalar(const ChannelBatch& batch, s32 *mixl, s32 *mixr, s32 *mixs)
+{
+	for (u32 i = 0; i < MIX_BATCH_SIZE; i++)
+	{
+		s32 sample = ((batch.s0[i] * (1024 - batch.fp[i])) >> 10) + ((batch.s1[i] * batch.fp[i]) >> 10);
+		s32 left = (sample * batch.gainLeft[i]) >> 15;
+		s32 right = (sample * batch.gainRight[i]) >> 15;
+		s32 dsp = (sample * batch.gainDsp[i]) >> 11;	// 20 bits
+		if (DspEnabled)
+			mixs[i] += dsp;
+		else if (left + right == 0)
+			left = right = dsp >> 4;
+		mixl[i] += left;
+		mixr[i] += right;
+	}
+}
+
+#if HOST_CPU == CPU_X86 || HOST_CPU == CPU_X64
+
+// Samples are 16-bit, interpolation weights and gains are in [0, 0x8000].
+// pmaddwd multiplies the signed low halves of each lane, the high half of the second operand being zero.
+// A gain of 0x8000 doesn't fit in 16 bits so gains are biased by -0x8000 and sample << 15 is added back.
+static inline __m128i mulWeight(__m128i sample, __m128i weight)
+{
+	return _mm_madd_epi16(sample, weight);
+}
+
+static inline __m128i mulGain(__m128i sample, __m128i sampleShl15, __m128i gain)
+{
+	const __m128i bias = _mm_set1_epi32(0x8000);
+	const __m128i lowHalf = _mm_set1_epi32(0xFFFF);
+	return _mm_add_epi32(_mm_madd_epi16(sample, _mm_and_si128(_mm_sub_epi32(gain, bias), lowHalf)), sampleShl15);
+}
+
+template<bool DspEnabled>
+static inline void mixBatch(const ChannelBatch& batch, s32 *mixl, s32 *mixr, s32 *mixs)
+{
+	const __m128i one = _mm_set1_epi32(1024);
+	for (u32 i = 0; i < MIX_BATCH_SIZE; i += 4)
+	{
+		__m128i fp = _mm_load_si128((const __m128i *)&batch.fp[i]);
+		__m128i s0 = _mm_load_si128((const __m128i *)&batch.s0[i]);
+		__m128i s1 = _mm_load_si128((const __m128i *)&batch.s1[i]);
+		__m128i sample = _mm_add_epi32(_mm_srai_epi32(mulWeight(s0, _mm_sub_epi32(one, fp)), 10),
+				_mm_srai_epi32(mulWeight(s1, fp), 10));
+		__m128i sampleShl15 = _mm_slli_epi32(sample, 15);
+
+		__m128i left = _mm_srai_epi32(mulGain(sample, sampleShl15, _mm_load_si128((const __m128i *)&batch.gainLeft[i])), 15);
+		__m128i right = _mm_srai_epi32(mulGain(sample, sampleShl15, _mm_load_si128((const __m128i *)&batch.gainRight[i])), 15);
+		__m128i dsp = _mm_srai_epi32(mulGain(sample, sampleShl15, _mm_load_si128((const __m128i *)&batch.gainDsp[i])), 11);
+		if (DspEnabled)
+		{
+			__m128i *ps = (__m128i *)&mixs[i];
+			_mm_store_si128(ps, _mm_add_epi32(_mm_load_si128(ps), dsp));
+		}
+		else
+		{
+			__m128i silent = _mm_cmpeq_epi32(_mm_add_epi32(left, right), _mm_setzero_si128());
+			dsp = _mm_srai_epi32(dsp, 4);
+			left = _mm_or_si128(_mm_and_si128(silent, dsp), _mm_andnot_si128(silent, left));
+			right = _mm_or_si128(_mm_and_si128(silent, dsp), _mm_andnot_si128(silent, right));
+		}
+
+		__m128i *pl = (__m128i *)&mixl[i];
+		__m128i *pr = (__m128i *)&mixr[i];
+		_mm_store_si128(pl, _mm_add_epi32(_mm_load_si128(pl), left));
+		_mm_store_si128(pr, _mm_add_epi32(_mm_load_si128(pr), right));
+	}
+}
+
+#elif defined(__ARM_NEON__) || defined(__aarch64__)
+
+template<bool DspEnabled>
+static inline void mixBatch(const ChannelBatch& batch, s32 *mixl, s32 *mixr, s32 *mixs)
+{
+	const int32x4_t one = vdupq_n_s32(1024);
+	for (u32 i = 0; i < MIX_BATCH_SIZE; i += 4)
+	{
+		int32x4_t fp = vld1q_s32(&batch.fp[i]);
+		int32x4_t sample = vaddq_s32(vshrq_n_s32(vmulq_s32(vld1q_s32(&batch.s0[i]), vsubq_s32(one, fp)), 10),
+				vshrq_n_s32(vmulq_s32(vld1q_s32(&batch.s1[i]), fp), 10));
+
+		int32x4_t left = vshrq_n_s32(vmulq_s32(sample, vld1q_s32(&batch.gainLeft[i])), 15);
+		int32x4_t right = vshrq_n_s32(vmulq_s32(sample, vld1q_s32(&batch.gainRight[i])), 15);
+		int32x4_t dsp = vshrq_n_s32(vmulq_s32(sample, vld1q_s32(&batch.gainDsp[i])), 11);
+		if (DspEnabled)
+		{
+			vst1q_s32(&mixs[i], vaddq_s32(vld1q_s32(&mixs[i]), dsp));
+		}
+		else
+		{
+			uint32x4_t silent = vceqq_s32(vaddq_s32(left, right), vdupq_n_s32(0));
+			dsp = vshrq_n_s32(dsp, 4);
+			left = vbslq_s32(silent, dsp, left);
+			right = vbslq_s32(silent, dsp, right);
+		}
+
+		vst1q_s32(&mixl[i], vaddq_s32(vld1q_s32(&mixl[i]), left));
+		vst1q_s32(&mixr[i], vaddq_s32(vld1q_s32(&mixr[i]), right));
+	}
+}
+
+#else
+
+template<bool DspEnabled>
+static inline void mixBatch(const ChannelBatch& batch, s32 *mixl, s32 *mixr, s32 *mixs)
+{
+	mixBatchScalar<DspEnabled>(batch, mixl, mixr, mixs);
+}
+
+#endif
@@ -26,6 +26,7 @@
 #include "hw/aica/aica_if.h"
 #include "hw/mem/_vmem.h"
 #include "arm_mem.h"
+#include "profiler/perf_jit.h"
 
 #if 0
 // for debug
@@ -553,6 +554,7 @@ void compile()
 
 	//setup local pc counter
 	u32 pc = arm_Reg[R15_ARM_NEXT].I;
+	const u32 startPc = pc;
 
 	//update the block table
 	// Note that we mask with the max aica size (8 MB), which is
@@ -639,6 +641,15 @@ void compile()
 
 	arm7backend_compile(block_ops, cycles);
 
+	if (perfjit::enabled())
+	{
+		u32 offset = startPc & ARAM_MASK;
+		char name[64];
+		sprintf(name, "arm7:%06X,c:%d,h:%08X", offset, cycles,
+				perfjit::guestHash(&aica_ram[offset], std::min(pc - startPc, ARAM_SIZE - offset)));
+		perfjit::codeLoaded(rv, (u32)(icPtr - (u8 *)rv), name);
+	}
+
 	arm_printf("arm7rec_compile done: %p,%p", rv, icPtr);
 }
 
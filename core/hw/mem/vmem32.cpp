@@ -379,6 +379,11 @@ bool vmem32_init()
 #else
 	if (config::DisableVmem32 || !_nvmem_4gb_space())
 		return false;
+#if FEAT_SHREC == DYNAREC_JIT && HOST_CPU == CPU_X64 && defined(FAST_MMU)
+	// The x64 dynarec uses its inline TLB, which isn't flushed when the ASID changes
+	if (config::DynarecMmuTlb)
+		return false;
+#endif
 	vmem32_inited = true;
 	vmem32_flush_mmu();
 	return true;
@@ -15,6 +15,9 @@
 #include "emulator.h"
 #include "rend/gui.h"
 
+#include <atomic>
+#include <thread>
+
 /*
 
   GPIO pins(main board: EEPROM, DIMM SPDs, option board: PIC16, JPs)
@@ -375,6 +378,7 @@ u64 GDCartridge::des_encrypt_decrypt(u64 src, const u32 *des_subkeys)
 
 	return (u64(r) << 32) | u64(l);
 }
+template u64 GDCartridge::des_encrypt_decrypt<true>(u64 src, const u32 *des_subkeys);
 
 u64 GDCartridge::rev64(u64 src)
 {
@@ -441,6 +445,55 @@ void GDCartridge::read_gdrom(Disc *gdrom, u32 sector, u8* dst, u32 count)
 	gdrom->ReadSectors(sector + 150, count, dst, 2048);
 }
 
+bool GDCartridge::decrypt_dimm_data(u64 key, u32 size)
+{
+	u32 des_subkeys[32];
+	des_generate_subkeys(rev64(key), des_subkeys);
+
+	// DES is used in ECB mode so the data is split in chunks decrypted concurrently
+	constexpr u32 CHUNK_SIZE = 256 * 1024;
+	const u32 chunks = (size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	std::atomic<u32> next_chunk(0);
+	std::atomic<u32> done_chunks(0);
+
+	auto worker = [&](bool report_progress) {
+		u32 progress = ~0;
+		for (;;)
+		{
+			if (loading_canceled)
+				break;
+			u32 chunk = next_chunk++;
+			if (chunk >= chunks)
+				break;
+			const u32 end = std::min(size, (chunk + 1) * CHUNK_SIZE);
+			for (u32 i = chunk * CHUNK_SIZE; i < end; i += 8)
+				*(u64 *)(dimm_data + i) = des_encrypt_decrypt<true>(*(u64 *)(dimm_data + i), des_subkeys);
+			done_chunks++;
+
+			if (report_progress)
+			{
+				const u32 new_progress = done_chunks * 100 / chunks;
+				if (progress != new_progress)
+				{
+					progress = new_progress;
+					char status_str[32];
+					sprintf(status_str, "Decrypting %d%%", progress);
+					gui_display_notification(status_str, 2000);
+				}
+			}
+		}
+	};
+	std::vector<std::thread> threads;
+	const u32 thread_count = std::min(std::max(std::thread::hardware_concurrency(), 1u), chunks);
+	for (u32 i = 1; i < thread_count; i++)
+		threads.emplace_back(worker, false);
+	worker(true);
+	for (auto& thread : threads)
+		thread.join();
+
+	return done_chunks == chunks;
+}
+
 void GDCartridge::device_start()
 {
 	if (dimm_data != NULL)
@@ -573,24 +626,7 @@ void GDCartridge::device_start()
 			read_gdrom(gdrom, file_start, dimm_data, sectors);
 
 			// decrypt loaded data
-			u32 des_subkeys[32];
-			des_generate_subkeys(rev64(key), des_subkeys);
-
-			u32 progress = ~0;
-			for (u32 i = 0; i < file_rounded_size; i += 8)
-			{
-				const u32 new_progress = (u32)(((u64)i + 8) * 100 / file_rounded_size);
-				if (progress != new_progress)
-				{
-					if (loading_canceled)
-						break;
-					progress = new_progress;
-					char status_str[16];
-					sprintf(status_str, "Decrypting %d%%", progress);
-					gui_display_notification(status_str, 2000);
-				}
-				*(u64 *)(dimm_data + i) = des_encrypt_decrypt<true>(*(u64 *)(dimm_data + i), des_subkeys);
-			}
+			decrypt_dimm_data(key, file_rounded_size);
 		}
 
 		delete gdrom;
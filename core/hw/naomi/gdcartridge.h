@@ -37,6 +37,16 @@ public:
 
 	void SetGDRomName(const char *name, const char *parentName) { this->gdrom_name = name; this->gdrom_parent_name = parentName; }
 
+protected:
+	u8 *dimm_data = nullptr;
+	u32 dimm_data_size = 0;
+
+	void des_generate_subkeys(u64 key, u32 *subkeys);
+	template<bool decrypt>
+	u64 des_encrypt_decrypt(u64 src, const u32 *des_subkeys);
+	u64 rev64(u64 src);
+	bool decrypt_dimm_data(u64 key, u32 size);
+
 private:
 	enum { FILENAME_LENGTH=24 };
 
@@ -45,9 +55,6 @@ private:
 
 	u32 dimm_cur_address = 0;
 
-	u8 *dimm_data = nullptr;
-	u32 dimm_data_size = 0;
-
 	static const u32 DES_LEFTSWAP[];
 	static const u32 DES_RIGHTSWAP[];
 	static const u32 DES_SBOX1[];
@@ -66,10 +73,6 @@ private:
 	void find_file(const char *name, const u8 *dir_sector, u32 &file_start, u32 &file_size);
 
 	inline void permutate(u32 &a, u32 &b, u32 m, int shift);
-	void des_generate_subkeys(u64 key, u32 *subkeys);
-	template<bool decrypt>
-	u64 des_encrypt_decrypt(u64 src, const u32 *des_subkeys);
-	u64 rev64(u64 src);
 	void read_gdrom(Disc *gdrom, u32 sector, u8* dst, u32 count = 1);
 };
 
@@ -1,6 +1,7 @@
 #include "Renderer_if.h"
 #include "spg.h"
 #include "cheats.h"
+#include "rewind.h"
 #include "hw/mem/_vmem.h"
 #include "hw/pvr/pvr_mem.h"
 #include "oslib/oslib.h"
@@ -393,6 +394,7 @@ void rend_vblank()
 	render_called = false;
 	check_framebuffer_write();
 	cheatManager.apply();
+	rewinder::vblank();
 }
 
 void check_framebuffer_write()
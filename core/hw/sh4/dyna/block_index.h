@@ -0,0 +1,171 @@
+/*
+	Copyright 2026 Flycast contributors
+
+	This file is part of Flycast.
+
+    Flycast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    Flycast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Flycast.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include "types.h"
+#include <algorithm>
+#include <vector>
+
+//
+// Host code address -> block index.
+// Blocks are kept in a flat vector sorted by code address. New blocks are appended at
+// the end while code is emitted past the last block. Once the code buffer wraps and
+// evicted regions are reused, they're inserted in the middle of the vector, which is O(n).
+// Removed blocks leave a hole that is compacted once holes make half of the vector.
+// If overlapping is set, code ranges may overlap (stale blocks of different cache
+// generations), in which case the most recently added block wins.
+//
+// T must be a pointer-like type with code and host_code_size members.
+//
+template<typename T>
+class BlockIndex
+{
+	struct Entry
+	{
+		u32 size;	// host code size when added
+		u32 seq;	// insertion order
+		T block;
+	};
+
+public:
+	BlockIndex(bool overlapping = false) : overlapping(overlapping) {}
+
+	void add(const T& block)
+	{
+		const u8 *code = (const u8 *)block->code;
+		Entry entry{ block->host_code_size, nextSeq++, block };
+		maxSize = std::max(maxSize, entry.size);
+		if (codes.empty() || codes.back() <= code)
+		{
+			codes.push_back(code);
+			entries.push_back(entry);
+			return;
+		}
+		size_t i = std::upper_bound(codes.begin(), codes.end(), code) - codes.begin();
+		// Reuse a hole at the same address if any
+		if (i > 0 && entries[i - 1].block == nullptr && codes[i - 1] == code)
+		{
+			entries[i - 1] = entry;
+			holes--;
+		}
+		else
+		{
+			codes.insert(codes.begin() + i, code);
+			entries.insert(entries.begin() + i, entry);
+		}
+	}
+
+	void remove(const T& block)
+	{
+		const u8 *code = (const u8 *)block->code;
+		size_t i = std::lower_bound(codes.begin(), codes.end(), code) - codes.begin();
+		for (; i < codes.size() && codes[i] == code; i++)
+		{
+			if (entries[i].block == block)
+			{
+				entries[i].block = nullptr;
+				if (++holes > entries.size() / 2)
+					compact();
+				return;
+			}
+		}
+		die("BlockIndex: block not found");
+	}
+
+	// Returns the block containing the given host code address, or null
+	T find(const void *p) const
+	{
+		const u8 *code = (const u8 *)p;
+		size_t i = std::upper_bound(codes.begin(), codes.end(), code) - codes.begin();
+		const Entry *found = nullptr;
+		while (i > 0)
+		{
+			i--;
+			uintptr_t offset = code - codes[i];
+			if (offset >= maxSize)
+				// No block can reach this address anymore
+				break;
+			const Entry& entry = entries[i];
+			if (entry.block == nullptr)
+				continue;
+			if (offset < entry.size && (found == nullptr || entry.seq > found->seq))
+				found = &entry;
+			if (!overlapping)
+				break;
+		}
+		return found == nullptr ? nullptr : found->block;
+	}
+
+	void clear()
+	{
+		codes.clear();
+		entries.clear();
+		holes = 0;
+		maxSize = 0;
+	}
+
+	bool empty() const {
+		return entries.size() == holes;
+	}
+	size_t size() const {
+		return entries.size() - holes;
+	}
+
+	template<typename F>
+	void forEach(F f) const
+	{
+		for (const Entry& entry : entries)
+			if (entry.block != nullptr)
+				f(entry.block);
+	}
+
+	// Calls f for each block whose code starts in [begin, end)
+	template<typename F>
+	void forEachInRange(const void *begin, const void *end, F f) const
+	{
+		size_t i = std::lower_bound(codes.begin(), codes.end(), (const u8 *)begin) - codes.begin();
+		for (; i < codes.size() && codes[i] < (const u8 *)end; i++)
+			if (entries[i].block != nullptr)
+				f(entries[i].block);
+	}
+
+private:
+	void compact()
+	{
+		size_t j = 0;
+		for (size_t i = 0; i < entries.size(); i++)
+		{
+			if (entries[i].block == nullptr)
+				continue;
+			codes[j] = codes[i];
+			entries[j] = std::move(entries[i]);
+			j++;
+		}
+		codes.resize(j);
+		entries.resize(j);
+		holes = 0;
+	}
+
+	const bool overlapping;
+	// Sorted code addresses, kept apart from the entries to speed up binary searches
+	std::vector<const u8 *> codes;
+	std::vector<Entry> entries;
+	size_t holes = 0;
+	u32 maxSize = 0;
+	u32 nextSeq = 0;
+};
@@ -0,0 +1,357 @@
+/*
+	Copyright 2021 flyinghead
+
+	This file is part of Flycast.
+
+    Flycast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    Flycast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Flycast.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "blockcache.h"
+#include "blockmanager.h"
+#include "ngen.h"
+#include "hw/sh4/sh4_core.h"
+#include "hw/sh4/sh4_mem.h"
+#include "hw/sh4/modules/mmu.h"
+#include "cfg/option.h"
+#include "emulator.h"
+
+#include <unordered_map>
+#include <xxhash.h>
+
+#if FEAT_SHREC != DYNAREC_NONE
+
+namespace blockcache
+{
+
+static const u8 FileMagic[8] = { 'F', 'L', 'Y', 'B', 'C', 'A', 'C', 'H' };
+static constexpr u32 FileVersion = 1;
+static constexpr u32 MaxOps = 512;
+
+struct FileHeader
+{
+	u8 magic[8];
+	u32 version;
+	u32 opSize;		// sizeof(shil_opcode)
+	u32 flags;		// decoder options the cached blocks depend on
+	u32 count;
+};
+
+struct EntryHeader
+{
+	u64 key;
+	u64 digest;
+	u32 sh4_code_size;
+	u32 guest_cycles;
+	u32 guest_opcodes;
+	u32 BlockType;
+	u32 BranchBlock;
+	u32 NextBlock;
+	u8 has_fpu_op;
+	u8 has_jcond;
+	u8 read_only;
+	u8 padding;
+	u32 opCount;
+};
+
+struct Entry
+{
+	EntryHeader header;
+	std::vector<shil_opcode> oplist;
+};
+
+static std::unordered_map<u64, Entry> entries;
+static Stats stats;
+static bool dirty;
+
+static u64 makeKey(const RuntimeBlockInfo *block)
+{
+	// Only the fpscr bits used by the decoder are relevant
+	u32 fpuMode = block->fpu_cfg.RM | (block->fpu_cfg.PR << 2) | (block->fpu_cfg.SZ << 3);
+	return ((u64)fpuMode << 32) | block->addr;
+}
+
+static u32 currentFlags()
+{
+	ngen_features features;
+	ngen_GetFeatures(&features);
+	return (config::DynarecSafeMode ? 1 : 0)
+			| (config::DynarecIdleSkip ? 2 : 0)
+			| (features.OnlyDynamicEnds ? 4 : 0)
+			| (features.InterpreterFallback ? 8 : 0)
+			| (config::DynarecSuperblocks ? 16 : 0);
+}
+
+// Hash of the guest memory a block depends on.
+// Optimized read-only blocks may have constant reads from the pages they span,
+// so the whole pages are hashed in this case.
+static bool digest(u32 addr, u32 size, bool read_only, u64& hash)
+{
+	if (size == 0 || !IsOnRam(addr))
+		return false;
+	u32 start = addr;
+	u32 end = addr + size;
+	if (read_only)
+	{
+		start &= ~PAGE_MASK;
+		end = (end + PAGE_MASK) & ~PAGE_MASK;
+	}
+	if ((start & RAM_MASK) + (end - start) > RAM_SIZE)
+		return false;
+	u8 *p = GetMemPtr(start, end - start);
+	if (p == nullptr)
+		return false;
+	hash = XXH64(p, end - start, 7);
+
+	return true;
+}
+
+static std::string getCachePath()
+{
+	std::string gameId = config::Settings::instance().getGameId();
+	if (gameId.empty())
+		return "";
+	for (char& c : gameId)
+		if (!isalnum((u8)c))
+			c = '_';
+	return get_writable_data_path(gameId + ".bcache");
+}
+
+static void load()
+{
+	entries.clear();
+	dirty = false;
+	memset(&stats, 0, sizeof(stats));
+	if (!config::DynarecBlockCache)
+		return;
+	std::string path = getCachePath();
+	if (path.empty())
+		return;
+	FILE *f = nowide::fopen(path.c_str(), "rb");
+	if (f == nullptr)
+		return;
+	std::fseek(f, 0, SEEK_END);
+	long size = std::ftell(f);
+	std::fseek(f, 0, SEEK_SET);
+	std::vector<u8> data(size > 0 ? size : 0);
+	bool ok = size > (long)(sizeof(FileHeader) + sizeof(u64))
+			&& std::fread(data.data(), 1, data.size(), f) == data.size();
+	std::fclose(f);
+	if (!ok)
+	{
+		WARN_LOG(DYNAREC, "Block cache %s: I/O error", path.c_str());
+		return;
+	}
+	// The file ends with a hash of its content
+	u64 fileHash;
+	size_t payloadSize = data.size() - sizeof(fileHash);
+	memcpy(&fileHash, &data[payloadSize], sizeof(fileHash));
+	if (XXH64(data.data(), payloadSize, 0) != fileHash)
+	{
+		WARN_LOG(DYNAREC, "Block cache %s: corrupted file", path.c_str());
+		return;
+	}
+	FileHeader header;
+	memcpy(&header, data.data(), sizeof(header));
+	if (memcmp(header.magic, FileMagic, sizeof(FileMagic))
+			|| header.version != FileVersion
+			|| header.opSize != sizeof(shil_opcode)
+			|| header.flags != currentFlags())
+	{
+		INFO_LOG(DYNAREC, "Block cache %s: obsolete file ignored", path.c_str());
+		return;
+	}
+	size_t offset = sizeof(header);
+	for (u32 i = 0; i < header.count; i++)
+	{
+		Entry entry;
+		if (offset + sizeof(EntryHeader) > payloadSize)
+			break;
+		memcpy(&entry.header, &data[offset], sizeof(EntryHeader));
+		offset += sizeof(EntryHeader);
+		u32 opCount = entry.header.opCount;
+		if (opCount == 0 || opCount > MaxOps || offset + opCount * sizeof(shil_opcode) > payloadSize)
+			break;
+		entry.oplist.resize(opCount);
+		memcpy(&entry.oplist[0], &data[offset], opCount * sizeof(shil_opcode));
+		offset += opCount * sizeof(shil_opcode);
+
+		bool valid = true;
+		for (const shil_opcode& op : entry.oplist)
+			if (op.op >= shop_max)
+			{
+				valid = false;
+				break;
+			}
+		if (valid)
+			entries[entry.header.key] = std::move(entry);
+	}
+	if (entries.size() != header.count)
+		WARN_LOG(DYNAREC, "Block cache %s: %d invalid entries", path.c_str(), (int)(header.count - entries.size()));
+	INFO_LOG(DYNAREC, "Block cache: loaded %d blocks from %s", (int)entries.size(), path.c_str());
+}
+
+static void save()
+{
+	if (!config::DynarecBlockCache)
+		return;
+	INFO_LOG(DYNAREC, "Block cache: %d hits %d misses %d rejected %d stored", stats.hits, stats.misses, stats.rejected, stats.stored);
+	if (!dirty)
+		return;
+	std::string path = getCachePath();
+	if (path.empty())
+		return;
+	FILE *f = nowide::fopen(path.c_str(), "wb");
+	if (f == nullptr)
+	{
+		WARN_LOG(DYNAREC, "Block cache: cannot create %s", path.c_str());
+		return;
+	}
+	XXH64_state_t *state = XXH64_createState();
+	XXH64_reset(state, 0);
+	bool ok = true;
+	auto write = [&](const void *p, size_t size) {
+		XXH64_update(state, p, size);
+		ok = ok && std::fwrite(p, 1, size, f) == size;
+	};
+	FileHeader header;
+	memcpy(header.magic, FileMagic, sizeof(FileMagic));
+	header.version = FileVersion;
+	header.opSize = sizeof(shil_opcode);
+	header.flags = currentFlags();
+	header.count = (u32)entries.size();
+	write(&header, sizeof(header));
+	for (const auto& it : entries)
+	{
+		write(&it.second.header, sizeof(EntryHeader));
+		write(&it.second.oplist[0], it.second.oplist.size() * sizeof(shil_opcode));
+	}
+	u64 fileHash = XXH64_digest(state);
+	XXH64_freeState(state);
+	ok = ok && std::fwrite(&fileHash, sizeof(fileHash), 1, f) == 1;
+	std::fclose(f);
+	if (!ok)
+	{
+		WARN_LOG(DYNAREC, "Block cache: error writing %s", path.c_str());
+		nowide::remove(path.c_str());
+	}
+	else
+	{
+		INFO_LOG(DYNAREC, "Block cache: saved %d blocks to %s", (int)entries.size(), path.c_str());
+		dirty = false;
+	}
+}
+
+static void eventCallback(Event event)
+{
+	switch (event)
+	{
+	case Event::Start:
+		load();
+		break;
+	case Event::Terminate:
+		save();
+		entries.clear();
+		break;
+	default:
+		break;
+	}
+}
+
+void init()
+{
+	EventManager::listen(Event::Start, eventCallback);
+	EventManager::listen(Event::Terminate, eventCallback);
+}
+
+void term()
+{
+	EventManager::unlisten(Event::Start, eventCallback);
+	EventManager::unlisten(Event::Terminate, eventCallback);
+	entries.clear();
+}
+
+bool lookup(RuntimeBlockInfo *block)
+{
+	if (!config::DynarecBlockCache || mmu_enabled())
+		return false;
+	auto it = entries.find(makeKey(block));
+	if (it == entries.end())
+	{
+		stats.misses++;
+		return false;
+	}
+	const EntryHeader& header = it->second.header;
+	if (header.has_fpu_op && sr.FD == 1)
+	{
+		// Let the decoder raise the FPU disabled exception
+		stats.misses++;
+		return false;
+	}
+	u64 hash;
+	if (bm_CanProtectBlock(block->addr, header.sh4_code_size) != (bool)header.read_only
+			|| !digest(block->addr, header.sh4_code_size, header.read_only, hash)
+			|| hash != header.digest)
+	{
+		stats.rejected++;
+		entries.erase(it);
+		dirty = true;
+		return false;
+	}
+	block->sh4_code_size = header.sh4_code_size;
+	block->guest_cycles = header.guest_cycles;
+	block->guest_opcodes = header.guest_opcodes;
+	block->BlockType = (BlockEndType)header.BlockType;
+	block->BranchBlock = header.BranchBlock;
+	block->NextBlock = header.NextBlock;
+	block->has_fpu_op = header.has_fpu_op;
+	block->has_jcond = header.has_jcond;
+	block->oplist = it->second.oplist;
+	stats.hits++;
+
+	return true;
+}
+
+void store(const RuntimeBlockInfo *block)
+{
+	if (!config::DynarecBlockCache || mmu_enabled()
+			|| block->oplist.empty() || block->oplist.size() > MaxOps)
+		return;
+	Entry entry;
+	EntryHeader& header = entry.header;
+	memset(&header, 0, sizeof(header));
+	if (!digest(block->addr, block->sh4_code_size, block->read_only, header.digest))
+		return;
+	header.key = makeKey(block);
+	header.sh4_code_size = block->sh4_code_size;
+	header.guest_cycles = block->guest_cycles;
+	header.guest_opcodes = block->guest_opcodes;
+	header.BlockType = block->BlockType;
+	header.BranchBlock = block->BranchBlock;
+	header.NextBlock = block->NextBlock;
+	header.has_fpu_op = block->has_fpu_op;
+	header.has_jcond = block->has_jcond;
+	header.read_only = block->read_only;
+	header.opCount = (u32)block->oplist.size();
+	entry.oplist = block->oplist;
+	entries[header.key] = std::move(entry);
+	stats.stored++;
+	dirty = true;
+}
+
+const Stats& getStats()
+{
+	return stats;
+}
+
+}
+#endif
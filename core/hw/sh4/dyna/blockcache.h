@@ -0,0 +1,49 @@
+/*
+	Copyright 2021 flyinghead
+
+	This file is part of Flycast.
+
+    Flycast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    Flycast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Flycast.  If not, see <https://www.gnu.org/licenses/>.
+*/
+// Persistent cache of decoded and optimized SH4 blocks.
+// Decoding and SSA optimization results are kept per game on disk so that
+// warm starts only need to run the host code generator.
+#pragma once
+#include "types.h"
+
+struct RuntimeBlockInfo;
+
+namespace blockcache
+{
+
+struct Stats
+{
+	u32 hits;
+	u32 misses;
+	u32 rejected;	// entry found but guest code or protection changed
+	u32 stored;
+};
+
+void init();
+void term();
+
+// Fills the block decoding results if a valid entry exists.
+// The block vaddr, addr and fpu_cfg must be set.
+bool lookup(RuntimeBlockInfo *block);
+// Adds or replaces the entry for a freshly decoded and optimized block
+void store(const RuntimeBlockInfo *block);
+
+const Stats& getStats();
+
+}
@@ -5,14 +5,16 @@
 
 #include <algorithm>
 #include <set>
-#include <map>
 #include "blockmanager.h"
+#include "blockcache.h"
+#include "block_index.h"
 #include "ngen.h"
 
 #include "../sh4_core.h"
 #include "hw/sh4/sh4_mem.h"
 #include "hw/sh4/sh4_opcode_list.h"
 #include "hw/sh4/sh4_sched.h"
+#include "profiler/perf_jit.h"
 
 
 #if defined(__unix__) && defined(DYNA_OPROF)
@@ -23,12 +25,89 @@ op_agent_t          oprofHandle;
 #if FEAT_SHREC != DYNAREC_NONE
 
 
-typedef std::vector<RuntimeBlockInfoPtr> bm_List;
 typedef std::set<RuntimeBlockInfoPtr> bm_Set;
-typedef std::map<void*, RuntimeBlockInfoPtr> bm_Map;
+typedef BlockIndex<RuntimeBlockInfoPtr> bm_Map;
+
+// Intrusive list of blocks. Every block allocated belongs to exactly one list:
+// live_blocks, del_blocks or free_blocks.
+class bm_Pool
+{
+public:
+	bool empty() const { return head == nullptr; }
+
+	void push_back(RuntimeBlockInfo* block)
+	{
+		block->pool_prev = tail;
+		block->pool_next = nullptr;
+		if (tail != nullptr)
+			tail->pool_next = block;
+		else
+			head = block;
+		tail = block;
+	}
+
+	RuntimeBlockInfo* pop_front()
+	{
+		RuntimeBlockInfo* block = head;
+		if (block != nullptr)
+			remove(block);
+		return block;
+	}
+
+	void remove(RuntimeBlockInfo* block)
+	{
+		if (block->pool_prev != nullptr)
+			block->pool_prev->pool_next = block->pool_next;
+		else
+			head = block->pool_next;
+		if (block->pool_next != nullptr)
+			block->pool_next->pool_prev = block->pool_prev;
+		else
+			tail = block->pool_prev;
+		block->pool_prev = block->pool_next = nullptr;
+	}
+
+	// Moves all the blocks of the other list at the end of this one
+	void splice(bm_Pool& other)
+	{
+		if (other.head == nullptr)
+			return;
+		if (tail != nullptr)
+		{
+			tail->pool_next = other.head;
+			other.head->pool_prev = tail;
+		}
+		else
+			head = other.head;
+		tail = other.tail;
+		other.head = other.tail = nullptr;
+	}
+
+	void deleteAll()
+	{
+		while (head != nullptr)
+		{
+			RuntimeBlockInfo* next = head->pool_next;
+			delete head;
+			head = next;
+		}
+		tail = nullptr;
+	}
+
+private:
+	RuntimeBlockInfo* head = nullptr;
+	RuntimeBlockInfo* tail = nullptr;
+};
 
 static bm_Set all_temp_blocks;
-static bm_List del_blocks;
+// Blocks in use, either compiling or in the block map
+static bm_Pool live_blocks;
+// Discarded blocks. Their code may still be running so they're kept until the next cleanup
+static bm_Pool del_blocks;
+// Recycled blocks
+static bm_Pool free_blocks;
+// Discarded blocks may overlap if the cache has been reset in between
+static bm_Map stale_blocks(true);
 
 bool unprotected_pages[RAM_SIZE_MAX/PAGE_SIZE];
 static std::set<RuntimeBlockInfo*> blocks_per_page[RAM_SIZE_MAX/PAGE_SIZE];
@@ -40,6 +119,15 @@ u32 unprotected_blocks;
 
 #define FPCA(x) ((DynarecCodeEntryPtr&)sh4rcb.fpcb[(x>>1)&FPCB_MASK])
 
+ReturnStackEntry bm_ReturnStack[RETURN_STACK_SIZE];
+u32 bm_ReturnStackTop;
+
+void bm_ClearReturnStack()
+{
+	for (ReturnStackEntry& entry : bm_ReturnStack)
+		entry.pc = NullAddress;
+}
+
 // addr must be a physical address
 // This returns an executable address
 static DynarecCodeEntryPtr DYNACALL bm_GetCode(u32 addr)
@@ -123,61 +211,82 @@ RuntimeBlockInfoPtr DYNACALL bm_GetBlock(u32 addr)
 // This takes a RX address and returns the info block ptr (RW space)
 RuntimeBlockInfoPtr bm_GetBlock(void* dynarec_code)
 {
-	if (blkmap.empty())
-		return NULL;
-
 	void *dynarecrw = CC_RX2RW(dynarec_code);
-	// Returns a block who's code addr is bigger than dynarec_code (or end)
-	auto iter = blkmap.upper_bound(dynarecrw);
-	if (iter == blkmap.begin())
+	RuntimeBlockInfoPtr block = blkmap.find(dynarecrw);
+	// The block host code size might have shrunk after relinking
+	if (block && !block->contains_code((u8*)dynarecrw))
 		return NULL;
-	iter--;  // Need to go back to find the potential candidate
 
-	// However it might be out of bounds, check for that
-	if ((u8*)iter->second->code + iter->second->host_code_size <= (u8*)dynarec_code)
-		return NULL;
-
-	verify(iter->second->contains_code((u8*)dynarecrw));
-	return iter->second;
+	return block;
 }
 
 static void bm_CleanupDeletedBlocks()
 {
-	del_blocks.clear();
+	free_blocks.splice(del_blocks);
+	stale_blocks.clear();
+}
+
+static void bm_ReleaseBlockStats(RuntimeBlockInfoPtr block)
+{
+	if (block->sh4_code_size != 0)
+	{
+		if (block->read_only)
+			protected_blocks--;
+		else
+			unprotected_blocks--;
+	}
+}
+
+static void bm_AddStaleBlock(RuntimeBlockInfoPtr block, bool codeStale = true)
+{
+	live_blocks.remove(block);
+	del_blocks.push_back(block);
+	if (codeStale)
+		stale_blocks.add(block);
+	bm_ReleaseBlockStats(block);
+}
+
+// Returns a recycled block if any, or a new one
+RuntimeBlockInfo* bm_AllocateBlock()
+{
+	RuntimeBlockInfo* block = free_blocks.pop_front();
+	if (block == nullptr)
+		block = ngen_AllocateBlock();
+	live_blocks.push_back(block);
+
+	return block;
+}
+
+// Returns a block that hasn't been added to the pool
+void bm_FreeBlock(RuntimeBlockInfo* block)
+{
+	live_blocks.remove(block);
+	free_blocks.push_back(block);
 }
 
 // Takes RX pointer and returns a RW pointer
 RuntimeBlockInfoPtr bm_GetStaleBlock(void* dynarec_code)
 {
 	void *dynarecrw = CC_RX2RW(dynarec_code);
-	if (del_blocks.empty())
-		return NULL;
-	// Start from the end to get the youngest one
-	auto it = del_blocks.end();
-	do
-	{
-		--it;
-		if ((*it)->contains_code((u8*)dynarecrw))
-			return *it;
-	} while (it != del_blocks.begin());
-
-	return NULL;
+	// Returns the youngest one
+	return stale_blocks.find(dynarecrw);
 }
 
 void bm_AddBlock(RuntimeBlockInfo* blk)
 {
-	RuntimeBlockInfoPtr block(blk);
+	RuntimeBlockInfoPtr block = blk;
 	if (block->temp_block)
 		all_temp_blocks.insert(block);
-	auto iter = blkmap.find((void*)blk->code);
-	if (iter != blkmap.end()) {
-		INFO_LOG(DYNAREC, "DUP: %08X %p %08X %p", iter->second->addr, iter->second->code, block->addr, block->code);
+	RuntimeBlockInfoPtr dup = blkmap.find((void*)blk->code);
+	if (dup) {
+		INFO_LOG(DYNAREC, "DUP: %08X %p %08X %p", dup->addr, dup->code, block->addr, block->code);
 		verify(false);
 	}
-	blkmap[(void*)block->code] = block;
+	blkmap.add(block);
 
 	verify((void*)bm_GetCode(block->addr) == (void*)ngen_FailedToFindBlock);
 	FPCA(block->addr) = (DynarecCodeEntryPtr)CC_RW2RX(block->code);
+	bm_ClearReturnStack();
 
 #ifdef DYNA_OPROF
 	if (oprofHandle)
@@ -192,18 +301,31 @@ void bm_AddBlock(RuntimeBlockInfo* blk)
 		}
 	}
 #endif
+	if (perfjit::enabled())
+	{
+		u8 *guestCode = GetMemPtr(block->addr, block->sh4_code_size);
+		char name[64];
+		sprintf(name, "sh4:%08X,c:%d,h:%08X", block->addr, block->guest_cycles,
+				guestCode != nullptr ? perfjit::guestHash(guestCode, block->sh4_code_size) : 0);
+		perfjit::codeLoaded((void *)CC_RW2RX(block->code), block->host_code_size, name);
+	}
 
 }
 
-void bm_DiscardBlock(RuntimeBlockInfo* block)
+// codeStale is false if the block code is about to be overwritten, so its link stubs can't be called anymore
+static void bm_DiscardBlock(RuntimeBlockInfo* block, bool codeStale)
 {
 	// Remove from block map
-	auto it = blkmap.find((void*)block->code);
-	verify(it != blkmap.end());
-	RuntimeBlockInfoPtr block_ptr = it->second;
+	RuntimeBlockInfoPtr block_ptr = blkmap.find((void*)block->code);
+	verify(block_ptr == block);
 
-	blkmap.erase(it);
+	blkmap.remove(block_ptr);
 
+	// The successors must not reference this block once recycled
+	if (block_ptr->pNextBlock != NULL)
+		block_ptr->pNextBlock->RemRef(block_ptr);
+	if (block_ptr->pBranchBlock != NULL)
+		block_ptr->pBranchBlock->RemRef(block_ptr);
 	block_ptr->pNextBlock = NULL;
 	block_ptr->pBranchBlock = NULL;
 	block_ptr->Relink();
@@ -211,14 +333,33 @@ void bm_DiscardBlock(RuntimeBlockInfo* block)
 	// Remove from jump table
 	verify((void*)bm_GetCode(block_ptr->addr) == (void*)block_ptr->code);
 	FPCA(block_ptr->addr) = ngen_FailedToFindBlock;
+	bm_ClearReturnStack();
 
 	if (block_ptr->temp_block)
 		all_temp_blocks.erase(block_ptr);
 
-	del_blocks.push_back(block_ptr);
+	bm_AddStaleBlock(block_ptr, codeStale);
 	block_ptr->Discard();
 }
 
+void bm_DiscardBlock(RuntimeBlockInfo* block)
+{
+	bm_DiscardBlock(block, true);
+}
+
+// Discards all the blocks whose code starts in [start, end) before the range is reused
+u32 bm_DiscardBlocks(void *start, void *end)
+{
+	std::vector<RuntimeBlockInfoPtr> blocks;
+	blkmap.forEachInRange(start, end, [&blocks](RuntimeBlockInfoPtr block) {
+		blocks.push_back(block);
+	});
+	for (RuntimeBlockInfoPtr block : blocks)
+		bm_DiscardBlock(block, false);
+
+	return (u32)blocks.size();
+}
+
 void bm_Periodical_1s()
 {
 	bm_CleanupDeletedBlocks();
@@ -290,19 +431,23 @@ void bm_ResetCache()
 {
 	ngen_ResetBlocks();
 	_vmem_bm_reset();
+	bm_ClearReturnStack();
 
-	for (const auto& it : blkmap)
-	{
-		RuntimeBlockInfoPtr block = it.second;
+	blkmap.forEach([](RuntimeBlockInfoPtr block) {
 		block->relink_data = 0;
 		block->pNextBlock = NULL;
 		block->pBranchBlock = NULL;
 		// needed for the transition to full mmu. Could perhaps limit it to the current block.
 		block->Relink();
-		// Avoid circular references
 		block->Discard();
-		del_blocks.push_back(block);
-	}
+		stale_blocks.add(block);
+		bm_ReleaseBlockStats(block);
+#ifdef DYNA_OPROF
+		if (oprofHandle && op_unload_native_code(oprofHandle, (uint64_t)block->code) != 0)
+			INFO_LOG(DYNAREC, "op_unload_native_code error");
+#endif
+	});
+	del_blocks.splice(live_blocks);
 
 	blkmap.clear();
 	// blkmap includes temp blocks as well
@@ -312,19 +457,6 @@ void bm_ResetCache()
 		block_list.clear();
 
 	memset(unprotected_pages, 0, sizeof(unprotected_pages));
-
-#ifdef DYNA_OPROF
-	if (oprofHandle)
-	{
-		for (int i=0;i<del_blocks.size();i++)
-		{
-			if (op_unload_native_code(oprofHandle, (uint64_t)del_blocks[i]->code) != 0)
-			{
-				INFO_LOG(DYNAREC, "op_unload_native_code error");
-			}
-		}
-	}
-#endif
 }
 
 void bm_ResetTempCache(bool full)
@@ -334,10 +466,18 @@ void bm_ResetTempCache(bool full)
 		for (const auto& block : all_temp_blocks)
 		{
 			FPCA(block->addr) = ngen_FailedToFindBlock;
-			blkmap.erase((void*)block->code);
+			blkmap.remove(block);
+			// Unlink before the block gets recycled
+			if (block->pNextBlock != NULL)
+				block->pNextBlock->RemRef(block);
+			if (block->pBranchBlock != NULL)
+				block->pBranchBlock->RemRef(block);
+			block->Discard();
 		}
+		bm_ClearReturnStack();
 	}
-	del_blocks.insert(del_blocks.begin(),all_temp_blocks.begin(),all_temp_blocks.end());
+	for (const auto& block : all_temp_blocks)
+		bm_AddStaleBlock(block);
 	all_temp_blocks.clear();
 }
 
@@ -350,6 +490,8 @@ void bm_Init()
 	else
 		INFO_LOG(DYNAREC, "bm: Oprofile integration enabled !");
 #endif
+	bm_ClearReturnStack();
+	blockcache::init();
 }
 
 void bm_Term()
@@ -359,7 +501,16 @@ void bm_Term()
 	
 	oprofHandle=0;
 #endif
+	blockcache::term();
 	bm_Reset();
+
+	blkmap.clear();
+	all_temp_blocks.clear();
+	for (auto& block_list : blocks_per_page)
+		block_list.clear();
+	live_blocks.deleteAll();
+	del_blocks.deleteAll();
+	free_blocks.deleteAll();
 }
 
 void bm_WriteBlockMap(const std::string& file)
@@ -368,13 +519,11 @@ void bm_WriteBlockMap(const std::string& file)
 	if (f)
 	{
 		INFO_LOG(DYNAREC, "Writing block map !");
-		for (auto& it : blkmap)
-		{
-			RuntimeBlockInfoPtr& block = it.second;
+		blkmap.forEach([f](RuntimeBlockInfoPtr block) {
 			fprintf(f, "block: %d:%08X:%p:%d:%d:%d\n", block->BlockType, block->addr, block->code, block->host_code_size, block->guest_cycles, block->guest_opcodes);
 			for(size_t j = 0; j < block->oplist.size(); j++)
 				fprintf(f,"\top: %zd:%d:%s\n", j, block->oplist[j].guest_offs, block->oplist[j].dissasm().c_str());
-		}
+		});
 		fclose(f);
 		INFO_LOG(DYNAREC, "Finished writing block map");
 	}
@@ -382,11 +531,9 @@ void bm_WriteBlockMap(const std::string& file)
 
 void sh4_jitsym(FILE* out)
 {
-	for (const auto& it : blkmap)
-	{
-		const RuntimeBlockInfoPtr& block = it.second;
+	blkmap.forEach([out](RuntimeBlockInfoPtr block) {
 		fprintf(out, "%p %d %08X\n", block->code, block->host_code_size, block->addr);
-	}
+	});
 }
 
 #if 0
@@ -495,27 +642,14 @@ void bm_Sort()
 }
 #endif
 
-RuntimeBlockInfo::~RuntimeBlockInfo()
-{
-	if (sh4_code_size != 0)
-	{
-		if (read_only)
-			protected_blocks--;
-		else
-			unprotected_blocks--;
-	}
-}
-
-void RuntimeBlockInfo::AddRef(const RuntimeBlockInfoPtr& other)
+void RuntimeBlockInfo::AddRef(RuntimeBlockInfoPtr other)
 { 
 	pre_refs.push_back(other); 
 }
 
-void RuntimeBlockInfo::RemRef(const RuntimeBlockInfoPtr& other)
+void RuntimeBlockInfo::RemRef(RuntimeBlockInfoPtr other)
 {
-	bm_List::iterator it = std::find(pre_refs.begin(), pre_refs.end(), other);
-	if (it != pre_refs.end())
-		pre_refs.erase(it);
+	pre_refs.erase(std::remove(pre_refs.begin(), pre_refs.end(), other), pre_refs.end());
 }
 
 void RuntimeBlockInfo::Discard()
@@ -543,24 +677,27 @@ void RuntimeBlockInfo::Discard()
 	}
 }
 
-void RuntimeBlockInfo::SetProtectedFlags()
+bool bm_CanProtectBlock(u32 addr, u32 sh4_code_size)
 {
 	// Don't write protect rom and BIOS/IP.BIN (Grandia II)
 	if (!IsOnRam(addr) || (addr & 0x1FFF0000) == 0x0c000000)
+		return false;
+	for (u32 page = addr & ~PAGE_MASK; page < addr + sh4_code_size; page += PAGE_SIZE)
+	{
+		if (unprotected_pages[(page & RAM_MASK) / PAGE_SIZE])
+			return false;
+	}
+	return true;
+}
+
+void RuntimeBlockInfo::SetProtectedFlags()
+{
+	if (!bm_CanProtectBlock(addr, sh4_code_size))
 	{
 		this->read_only = false;
 		unprotected_blocks++;
 		return;
 	}
-	for (u32 addr = this->addr & ~PAGE_MASK; addr < this->addr + sh4_code_size; addr += PAGE_SIZE)
-	{
-		if (unprotected_pages[(addr & RAM_MASK) / PAGE_SIZE])
-		{
-			this->read_only = false;
-			unprotected_blocks++;
-			return;
-		}
-	}
 	this->read_only = true;
 	protected_blocks++;
 	for (u32 addr = this->addr & ~PAGE_MASK; addr < this->addr + sh4_code_size; addr += PAGE_SIZE)
@@ -655,12 +792,10 @@ void print_blocks()
 		INFO_LOG(DYNAREC, "Writing blocks to %p", f);
 	}
 
-	for (auto it : blkmap)
-	{
-		RuntimeBlockInfoPtr blk = it.second;
+	blkmap.forEach([f](RuntimeBlockInfoPtr blk) {
 		if (f)
 		{
-			fprintf(f,"block: %p\n",blk.get());
+			fprintf(f,"block: %p\n",blk);
 			fprintf(f,"vaddr: %08X\n",blk->vaddr);
 			fprintf(f,"paddr: %08X\n",blk->addr);
 			fprintf(f,"hash: %s\n",blk->hash());
@@ -717,7 +852,7 @@ void print_blocks()
 		}
 
 		blk->runs=0;
-	}
+	});
 
 	if (f) fclose(f);
 }
@@ -7,10 +7,9 @@
 #include "decoder.h"
 #include "stdclass.h"
 
-#include <memory>
-
 typedef void (*DynarecCodeEntryPtr)();
-typedef std::shared_ptr<RuntimeBlockInfo> RuntimeBlockInfoPtr;
+// Blocks are owned by the block manager pool and recycled once discarded
+typedef RuntimeBlockInfo* RuntimeBlockInfoPtr;
 
 struct RuntimeBlockInfo_Core
 {
@@ -21,16 +20,22 @@ struct RuntimeBlockInfo_Core
 
 struct RuntimeBlockInfo: RuntimeBlockInfo_Core
 {
-	bool Setup(u32 pc,fpscr_t fpu_cfg);
+	void Reset();
+	bool Setup(u32 pc,fpscr_t fpu_cfg,bool optimise);
+	// Copies the decoding results of a staging block so that it can be optimized separately.
+	// The block is decoded again as a superblock if it ends with a branch that can be followed.
+	// SetProtectedFlags must be called before adding the copy to the block manager.
+	void SetupCopy(const RuntimeBlockInfo& staging);
 	const char* hash();
 
 	u32 vaddr;
+	u32 id;		// unique for each setup
 
 	u32 host_code_size;	//in bytes
 	u32 sh4_code_size; //in bytes
 
 	u32 runs;
-	s32 staging_runs;
+	s32 staging_runs;	// runs left before a staging block is recompiled with optimizations
 
 	fpscr_t fpu_cfg;
 	u32 guest_cycles;
@@ -39,6 +44,7 @@ struct RuntimeBlockInfo: RuntimeBlockInfo_Core
 	bool has_fpu_op;
 	u32 blockcheck_failures;
 	bool temp_block;
+	bool optimized;		// SSA optimizations have been applied
 
 	u32 BranchBlock; //if not 0xFFFFFFFF then jump target
 	u32 NextBlock;   //if not 0xFFFFFFFF then next block (by position)
@@ -60,7 +66,7 @@ struct RuntimeBlockInfo: RuntimeBlockInfo_Core
 		return ((unat)(ptr-(u8*)code))<host_code_size;
 	}
 
-	virtual ~RuntimeBlockInfo();
+	virtual ~RuntimeBlockInfo() = default;
 
 	virtual u32 Relink()=0;
 	virtual void Relocate(void* dst)=0;
@@ -68,17 +74,34 @@ struct RuntimeBlockInfo: RuntimeBlockInfo_Core
 	//predecessors references
 	std::vector<RuntimeBlockInfoPtr> pre_refs;
 
-	void AddRef(const RuntimeBlockInfoPtr& other);
-	void RemRef(const RuntimeBlockInfoPtr& other);
+	void AddRef(RuntimeBlockInfoPtr other);
+	void RemRef(RuntimeBlockInfoPtr other);
 
 	void Discard();
 	void SetProtectedFlags();
 
 	bool read_only;
+
+	// block pool list (live, stale or free)
+	RuntimeBlockInfo* pool_prev;
+	RuntimeBlockInfo* pool_next;
 };
 
 void bm_WriteBlockMap(const std::string& file);
 
+// Shadow return stack. Calls push their return address with the code of the block at this address,
+// and returns jump directly to this code if the address matches.
+// The code pointers are only valid until the jump table changes, so the stack is cleared when it does.
+struct ReturnStackEntry
+{
+	u32 pc;
+	DynarecCodeEntryPtr code;
+};
+constexpr u32 RETURN_STACK_SIZE = 16;
+extern ReturnStackEntry bm_ReturnStack[RETURN_STACK_SIZE];
+extern u32 bm_ReturnStackTop;
+void bm_ClearReturnStack();
+
 
 extern "C" {
 ATTR_USED DynarecCodeEntryPtr DYNACALL bm_GetCodeByVAddr(u32 addr);
@@ -88,8 +111,11 @@ RuntimeBlockInfoPtr bm_GetBlock(void* dynarec_code);
 RuntimeBlockInfoPtr bm_GetStaleBlock(void* dynarec_code);
 RuntimeBlockInfoPtr DYNACALL bm_GetBlock(u32 addr);
 
+RuntimeBlockInfo* bm_AllocateBlock();
+void bm_FreeBlock(RuntimeBlockInfo* blk);
 void bm_AddBlock(RuntimeBlockInfo* blk);
 void bm_DiscardBlock(RuntimeBlockInfo* block);
+u32 bm_DiscardBlocks(void *start, void *end);
 void bm_Reset();
 void bm_ResetCache();
 void bm_ResetTempCache(bool full);
@@ -98,6 +124,7 @@ void bm_Periodical_1s();
 void bm_Init();
 void bm_Term();
 
+bool bm_CanProtectBlock(u32 addr, u32 sh4_code_size);
 void bm_vmem_pagefill(void** ptr,u32 size_bytes);
 bool bm_RamWriteAccess(void *p);
 void bm_RamWriteAccess(u32 addr);
@@ -0,0 +1,301 @@
+/*
+	Copyright 2026 Flycast contributors
+
+	This file is part of Flycast.
+
+    Flycast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    Flycast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Flycast.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "blockoptimizer.h"
+#include "blockmanager.h"
+#include "decoder.h"
+#include "hw/sh4/sh4_interpreter.h"
+#include "hw/sh4/sh4_mem.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#if FEAT_SHREC != DYNAREC_NONE
+
+void AnalyseBlock(RuntimeBlockInfo* blk);
+
+namespace blockoptimizer
+{
+
+// Beyond this, hot blocks wait for a slot and keep running unoptimized
+static constexpr size_t MaxJobs = 64;
+// Beyond this, missed blocks are decoded on the emulation thread
+static constexpr size_t MaxDecodeJobs = 256;
+// Guest code copied before decoding a block. Larger blocks are decoded on the emulation thread.
+static constexpr u32 DecodeWindow = 4096;
+
+struct Job
+{
+	RuntimeBlockInfo *staging;	// null for decode jobs
+	u32 stagingId;
+	RuntimeBlockInfo *block;	// copy being optimized or block being decoded
+	std::vector<u8> guestCode;	// guest code the block has been decoded from
+	bool decoded = false;
+	std::atomic<bool> done { false };
+};
+
+// Only used by the emulation thread
+static std::unordered_map<RuntimeBlockInfo *, std::unique_ptr<Job>> jobs;
+static std::unordered_map<u32, std::unique_ptr<Job>> decodeJobs;
+
+static std::mutex mutex;
+static std::condition_variable wakeup;
+static std::condition_variable idle;
+static std::deque<Job *> queue;
+static bool busy;
+static bool running;
+static std::thread thread;
+
+static void decode(Job& job)
+{
+	RuntimeBlockInfo *block = job.block;
+	u32 size = std::min(DecodeWindow, RAM_SIZE - (block->addr & RAM_MASK));
+	const u8 *code = GetMemPtr(block->addr, size);
+	job.guestCode.assign(code, code + size);
+	if (!dec_DecodeBlock(block, SH4_TIMESLICE / 2, false, true))
+		return;
+	// The guest code may be modified by the emulation thread while it's decoded
+	if (block->sh4_code_size > size || memcmp(code, job.guestCode.data(), block->sh4_code_size) != 0)
+		return;
+	job.guestCode.resize(block->sh4_code_size);
+	job.decoded = true;
+}
+
+static void threadLoop()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true)
+	{
+		wakeup.wait(lock, []() { return !running || !queue.empty(); });
+		if (!running)
+			break;
+		Job *job = queue.front();
+		queue.pop_front();
+		busy = true;
+		lock.unlock();
+
+		if (job->staging == nullptr)
+		{
+			decode(*job);
+		}
+		else
+		{
+			AnalyseBlock(job->block);
+			job->block->optimized = true;
+		}
+		job->done.store(true, std::memory_order_release);
+
+		lock.lock();
+		busy = false;
+		if (queue.empty())
+			idle.notify_all();
+	}
+}
+
+void init()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (running)
+		return;
+	running = true;
+	thread = std::thread(threadLoop);
+}
+
+static void stopThread()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!running)
+			return;
+		running = false;
+		queue.clear();
+	}
+	wakeup.notify_one();
+	thread.join();
+}
+
+// Stops the thread if the process exits without calling term()
+static struct ThreadGuard {
+	~ThreadGuard() {
+		stopThread();
+	}
+} threadGuard;
+
+void term()
+{
+	stopThread();
+	reset();
+}
+
+// The staging block has been discarded, and possibly recycled, since it was queued
+static bool isStale(const Job& job)
+{
+	return job.staging->id != job.stagingId || bm_GetBlock(job.staging->addr) != job.staging;
+}
+
+static void purge()
+{
+	for (auto it = jobs.begin(); it != jobs.end(); )
+	{
+		Job& job = *it->second;
+		if (job.done.load(std::memory_order_acquire) && isStale(job))
+		{
+			bm_FreeBlock(job.block);
+			it = jobs.erase(it);
+		}
+		else
+			++it;
+	}
+}
+
+RuntimeBlockInfo *getOptimized(RuntimeBlockInfo *staging)
+{
+	auto it = jobs.find(staging);
+	if (it != jobs.end())
+	{
+		Job& job = *it->second;
+		if (job.stagingId == staging->id)
+		{
+			if (!job.done.load(std::memory_order_acquire))
+				return nullptr;
+			RuntimeBlockInfo *block = job.block;
+			jobs.erase(it);
+			return block;
+		}
+		// Job of a previous use of this block
+		if (!job.done.load(std::memory_order_acquire))
+			return nullptr;
+		bm_FreeBlock(job.block);
+		jobs.erase(it);
+	}
+	if (jobs.size() >= MaxJobs)
+	{
+		purge();
+		if (jobs.size() >= MaxJobs)
+			return nullptr;
+	}
+	Job *job = new Job();
+	job->staging = staging;
+	job->stagingId = staging->id;
+	job->block = bm_AllocateBlock();
+	job->block->SetupCopy(*staging);
+	jobs[staging] = std::unique_ptr<Job>(job);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		queue.push_back(job);
+	}
+	wakeup.notify_one();
+
+	return nullptr;
+}
+
+bool getDecoded(u32 pc, fpscr_t fpu_cfg, RuntimeBlockInfo*& block)
+{
+	block = nullptr;
+	auto it = decodeJobs.find(pc);
+	if (it != decodeJobs.end())
+	{
+		Job& job = *it->second;
+		if (!job.done.load(std::memory_order_acquire))
+			return true;
+		RuntimeBlockInfo *decoded = job.block;
+		// Only the fpscr bits used by the decoder are relevant
+		bool valid = job.decoded
+				&& decoded->fpu_cfg.RM == fpu_cfg.RM && decoded->fpu_cfg.PR == fpu_cfg.PR && decoded->fpu_cfg.SZ == fpu_cfg.SZ
+				&& memcmp(GetMemPtr(decoded->addr, decoded->sh4_code_size), job.guestCode.data(), decoded->sh4_code_size) == 0;
+		decodeJobs.erase(it);
+		if (valid)
+		{
+			block = decoded;
+			return true;
+		}
+		bm_FreeBlock(decoded);
+		return false;
+	}
+	if (GetMemPtr(pc, 0) == nullptr)
+		return false;
+	if (decodeJobs.size() >= MaxDecodeJobs)
+	{
+		// Drop the blocks that haven't been missed since they've been decoded
+		for (auto it = decodeJobs.begin(); it != decodeJobs.end(); )
+		{
+			if (it->second->done.load(std::memory_order_acquire))
+			{
+				bm_FreeBlock(it->second->block);
+				it = decodeJobs.erase(it);
+			}
+			else
+				++it;
+		}
+		if (decodeJobs.size() >= MaxDecodeJobs)
+			return false;
+	}
+	Job *job = new Job();
+	job->staging = nullptr;
+	job->stagingId = 0;
+	job->block = bm_AllocateBlock();
+	job->block->Reset();
+	job->block->vaddr = pc;
+	job->block->addr = pc;
+	job->block->fpu_cfg = fpu_cfg;
+	job->block->oplist.clear();
+	decodeJobs[pc] = std::unique_ptr<Job>(job);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		// The emulation thread is interpreting this block until it's decoded
+		queue.push_front(job);
+	}
+	wakeup.notify_one();
+
+	return true;
+}
+
+bool isDecoding(u32 pc)
+{
+	return decodeJobs.count(pc) != 0;
+}
+
+void wait()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	idle.wait(lock, []() { return !running || (queue.empty() && !busy); });
+}
+
+void reset()
+{
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		queue.clear();
+		idle.wait(lock, []() { return !busy; });
+	}
+	for (const auto& it : jobs)
+		bm_FreeBlock(it.second->block);
+	jobs.clear();
+	for (const auto& it : decodeJobs)
+		bm_FreeBlock(it.second->block);
+	decodeJobs.clear();
+}
+
+}
+#endif
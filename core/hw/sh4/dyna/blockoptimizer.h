@@ -0,0 +1,52 @@
+/*
+	Copyright 2026 Flycast contributors
+
+	This file is part of Flycast.
+
+    Flycast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    Flycast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Flycast.  If not, see <https://www.gnu.org/licenses/>.
+*/
+// Runs the SSA optimizer of hot staging blocks and the decoder of missed blocks on a worker thread.
+// Staging blocks keep running until their optimized copy is ready, and missed blocks are
+// interpreted until they're decoded. The results are compiled and published by the emulation thread
+// since all the backends share a single code cache.
+#pragma once
+#include "types.h"
+#include "hw/sh4/sh4_if.h"
+
+struct RuntimeBlockInfo;
+
+namespace blockoptimizer
+{
+
+void init();
+void term();
+
+// Returns the optimized copy of a live staging block if it's ready, or null.
+// The block is queued for optimization if it isn't already.
+// The copy is owned by the caller, and must be added to the block manager or freed.
+RuntimeBlockInfo *getOptimized(RuntimeBlockInfo *staging);
+// Gets the block at pc decoded with the given fpu config if it's ready, or null.
+// The block is queued for decoding if it isn't already. The mmu and sr.FD must be off.
+// Returns false if the block must be decoded by the emulation thread: pc isn't in system ram,
+// there are too many jobs, or the guest code has been modified since it was queued.
+// The block is owned by the caller, and must be added to the block manager or freed.
+bool getDecoded(u32 pc, fpscr_t fpu_cfg, RuntimeBlockInfo*& block);
+// Returns true if the block at pc is queued for decoding
+bool isDecoding(u32 pc);
+// Drops all jobs. Called when the code cache is cleared.
+void reset();
+// Waits until all queued blocks are decoded or optimized
+void wait();
+
+}
@@ -20,7 +20,8 @@
 #define BLOCK_MAX_SH_OPS_SOFT 500
 #define BLOCK_MAX_SH_OPS_HARD 511
 
-static RuntimeBlockInfo* blk;
+// Blocks can be decoded by the emulation thread and a background compile thread at the same time
+static thread_local RuntimeBlockInfo* blk;
 
 static const char idle_hash[] =
        //BIOS
@@ -61,7 +62,7 @@ static inline shil_param mk_regi(int reg)
 	return mk_reg((Sh4RegType)reg);
 }
 
-static state_t state;
+static thread_local state_t state;
 
 static void Emit(shilop op,shil_param rd=shil_param(),shil_param rs1=shil_param(),shil_param rs2=shil_param(),u32 flags=0,shil_param rs3=shil_param(),shil_param rd2=shil_param())
 {
@@ -564,9 +565,9 @@ static void dec_param(DecParam p,shil_param& r1,shil_param& r2, u32 op)
 #define DIV1_KEY 0x3004
 #define ROTCL_KEY 0x4024
 
-static Sh4RegType div_som_reg1;
-static Sh4RegType div_som_reg2;
-static Sh4RegType div_som_reg3;
+static thread_local Sh4RegType div_som_reg1;
+static thread_local Sh4RegType div_som_reg2;
+static thread_local Sh4RegType div_som_reg3;
 
 static u32 MatchDiv32(u32 pc , Sh4RegType &reg1,Sh4RegType &reg2 , Sh4RegType &reg3)
 {
@@ -997,11 +998,99 @@ void dec_updateBlockCycles(RuntimeBlockInfo *block, u16 op)
 	}
 }
 
-bool dec_DecodeBlock(RuntimeBlockInfo* rbi,u32 max_cycles)
+// Returns the address an rts returns to if pr has been set by a call of this superblock
+// and hasn't been modified since.
+static u32 dec_ReturnAddress()
+{
+	for (auto it = blk->oplist.rbegin(); it != blk->oplist.rend(); ++it)
+	{
+		if (it->op == shop_ifb)
+			return NullAddress;
+		if ((it->rd.is_reg() && it->rd._reg == reg_pr) || (it->rd2.is_reg() && it->rd2._reg == reg_pr))
+		{
+			if (it->op == shop_mov32 && it->rs1.is_imm())
+				return it->rs1._imm;
+			return NullAddress;
+		}
+	}
+	return NullAddress;
+}
+
+// Continues decoding at the target of the unconditional branch ending the current segment.
+// The superblock is write-protected so it doesn't need to check its code, which is only possible if all
+// its segments are in the pages of the first one.
+static bool dec_FollowBranch(u32& max_pc, u32 max_cycles)
+{
+	if (!state.cpu.is_delayslot || blk->oplist.size() >= BLOCK_MAX_SH_OPS_SOFT || blk->guest_cycles >= max_cycles
+			|| state.trace.segments == ARRAY_SIZE(state.trace.targets))
+		return false;
+	u32 target;
+	switch (state.BlockType)
+	{
+	case BET_StaticJump:
+	case BET_StaticCall:
+		target = state.JumpAddr;
+		// Loops are left to block linking
+		for (u32 i = 0; i < state.trace.segments; i++)
+			if (state.trace.targets[i] == target)
+				return false;
+		break;
+	case BET_DynamicRet:
+		target = dec_ReturnAddress();
+		if (target == NullAddress)
+			return false;
+		break;
+	default:
+		return false;
+	}
+	if (state.trace.segments == 1)
+	{
+		if ((config::DynarecIdleSkip && strstr(idle_hash, blk->hash()))
+				|| !bm_CanProtectBlock(blk->addr, state.cpu.rpc - blk->vaddr))
+		{
+			state.trace.enabled = false;
+			return false;
+		}
+		state.trace.start = blk->vaddr & ~PAGE_MASK;
+		state.trace.end = (state.cpu.rpc + PAGE_MASK) & ~PAGE_MASK;
+		// leave room for a delay slot
+		max_pc = state.trace.end - 2;
+	}
+	if (target < state.trace.start || target >= max_pc)
+		return false;
+
+	if (state.BlockType == BET_DynamicRet)
+	{
+		// the return address is static
+		for (auto it = blk->oplist.rbegin(); it != blk->oplist.rend(); ++it)
+			if (it->op == shop_jdyn)
+			{
+				blk->oplist.erase(std::next(it).base());
+				break;
+			}
+	}
+	else
+	{
+		state.trace.targets[state.trace.segments++] = target;
+	}
+	state.trace.codeEnd = std::max(state.trace.codeEnd, state.cpu.rpc);
+	state.cpu.rpc = target;
+	state.cpu.is_delayslot = false;
+	state.NextOp = NDO_NextOp;
+
+	return true;
+}
+
+bool dec_DecodeBlock(RuntimeBlockInfo* rbi,u32 max_cycles,bool superblock,bool background)
 {
 	blk=rbi;
 	state_Setup(blk->vaddr, blk->fpu_cfg);
 	ngen_GetFeatures(&state.ngen);
+	// Exceptions can't be raised once the first segment has been decoded
+	state.trace.enabled = superblock && !mmu_enabled() && sr.FD == 0;
+	state.trace.segments = 1;
+	state.trace.targets[0] = blk->vaddr;
+	state.trace.codeEnd = blk->vaddr;
 	
 	blk->guest_opcodes=0;
 	// If full MMU, don't allow the block to extend past the end of the current 4K page
@@ -1031,7 +1120,7 @@ bool dec_DecodeBlock(RuntimeBlockInfo* rbi,u32 max_cycles)
 
 					if (OpDesc[op]->IsFloatingPoint())
 					{
-						if (sr.FD == 1)
+						if (!background && sr.FD == 1)
 						{
 							// We need to know FPSCR to compile the block, so let the exception handler run first
 							// as it may change the fp registers
@@ -1068,38 +1157,14 @@ bool dec_DecodeBlock(RuntimeBlockInfo* rbi,u32 max_cycles)
 			break;
 
 		case NDO_End:
-			// Disabled for now since we need to know if the block is read-only,
-			// which isn't determined until after the decoding.
-			// This is a relatively rare optimization anyway
-#if 0
-			// detect if calling an empty subroutine and skip it
-			if (state.BlockType == BET_StaticCall && blk->read_only)
-			{
-				if ((state.JumpAddr >> 12) == (blk->vaddr >> 12)
-						|| (state.JumpAddr >> 12) == ((blk->vaddr + (blk->guest_opcodes - 1) * 2) >> 12))
-				{
-					u32 op = IReadMem16(state.JumpAddr);
-					if (op == 0x000B)	// rts
-					{
-						u16 delayOp = IReadMem16(state.JumpAddr + 2);
-						if (delayOp == 0x0000 || delayOp == 0x0009)	// nop
-						{
-							state.NextOp = NDO_NextOp;
-							state.cpu.is_delayslot = false;
-							dec_updateBlockCycles(blk, op);
-							dec_updateBlockCycles(blk, delayOp);
-							continue;
-						}
-					}
-				}
-			}
-#endif
+			if (state.trace.enabled && dec_FollowBranch(max_pc, max_cycles))
+				continue;
 			goto _end;
 		}
 	}
 
 _end:
-	blk->sh4_code_size=state.cpu.rpc-blk->vaddr;
+	blk->sh4_code_size=std::max(state.trace.codeEnd, state.cpu.rpc)-blk->vaddr;
 	blk->NextBlock=state.NextAddr;
 	blk->BranchBlock=state.JumpAddr;
 	blk->BlockType=state.BlockType;
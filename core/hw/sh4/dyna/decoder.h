@@ -44,7 +44,11 @@ struct ngen_features
 };
 
 struct RuntimeBlockInfo;
-bool dec_DecodeBlock(RuntimeBlockInfo* rbi,u32 max_cycles);
+// If superblock is true, static jumps, static calls and returns to a known address
+// are followed so that the block spans the whole chain.
+// If background is true, the block is decoded by another thread than the emulation thread. The cpu state isn't
+// looked at: the mmu and sr.FD must have been off when the block was requested.
+bool dec_DecodeBlock(RuntimeBlockInfo* rbi,u32 max_cycles,bool superblock=false,bool background=false);
 void dec_updateBlockCycles(RuntimeBlockInfo *block, u16 op);
 
 struct state_t
@@ -72,6 +76,16 @@ struct state_t
 		bool has_writem;
 		bool has_fpu;
 	} info;
+
+	struct
+	{
+		bool enabled;
+		u32 segments;
+		u32 targets[16];	// start address of each segment
+		u32 start;		// the superblock must stay within the pages of its first segment
+		u32 end;
+		u32 codeEnd;	// end of the previous segments
+	} trace;
 };
 
 const u32 NullAddress = 0xFFFFFFFF;
@@ -11,8 +11,11 @@
 
 #include <ctime>
 #include <cfloat>
+#include <cinttypes>
 
 #include "blockmanager.h"
+#include "blockcache.h"
+#include "blockoptimizer.h"
 #include "ngen.h"
 #include "decoder.h"
 
@@ -45,9 +48,69 @@ std::unordered_set<u32> smc_hotspots;
 
 static sh4_if sh4Interp;
 
+// The code cache is split in regions that are filled in turn. When the current region is full,
+// the next one, which holds the oldest blocks, is evicted and reused.
+#if FEAT_SHREC == DYNAREC_CPP
+// blocks aren't emitted in the code cache
+constexpr u32 CODE_REGIONS = 1;
+// blocks don't count their runs
+constexpr bool TieredCompilation = false;
+#else
+constexpr u32 CODE_REGIONS = 8;
+constexpr bool TieredCompilation = true;
+#endif
+// Backends whose ngen_FailedToFindBlock calls rdv_CompileOrInterpret
+#if FEAT_SHREC == DYNAREC_JIT && HOST_CPU == CPU_X64
+constexpr bool AsyncCompileSupported = true;
+#else
+constexpr bool AsyncCompileSupported = false;
+#endif
+// Blocks are first compiled without SSA optimizations. They are recompiled with optimizations after running this many times.
+constexpr s32 HotBlockRuns = 100;
+// Start of the first region. The code emitted by ngen_ResetBlocks before it is never evicted.
+static u32 regionBase;
+static u32 currentRegion;
+
+static DynarecCacheStats cacheStats;
+// Addresses of all the blocks compiled since the last reset
+static std::unordered_set<u32> compiledBlocks;
+
+static u32 regionStart(u32 region)
+{
+	u32 regionSize = ((CODE_SIZE - regionBase) / CODE_REGIONS) & ~15;
+	return regionBase + regionSize * region;
+}
+
+static u32 regionEnd(u32 region)
+{
+	return region == CODE_REGIONS - 1 ? CODE_SIZE : regionStart(region + 1);
+}
+
+// Must be called after ngen_ResetBlocks so that the regions start after the main loop and stubs
+static void resetRegions()
+{
+	// Evicting a region would overwrite them otherwise
+	verify(CODE_REGIONS == 1 || LastAddr != 0);
+	regionBase = LastAddr;
+	currentRegion = 0;
+}
+
 void* emit_GetCCPtr() { return emit_ptr==0?(void*)&CodeCache[LastAddr]:(void*)emit_ptr; }
 void emit_SetBaseAddr() { LastAddr_min = LastAddr; }
 
+const DynarecCacheStats& rdv_GetCacheStats()
+{
+	return cacheStats;
+}
+
+static void logCacheStats()
+{
+	INFO_LOG(DYNAREC, "Code cache: %" PRIu64 " compiles %" PRIu64 " recompiles %" PRIu64 " promotions %" PRIu64 " hits %" PRIu64 " evictions (%" PRIu64 " blocks) "
+			"%" PRIu64 " smc invalidations %" PRIu64 " flushes %" PRIu64 " async compiles %" PRIu64 " interpreted",
+			cacheStats.compiles, cacheStats.recompiles, cacheStats.promotions, cacheStats.hits, cacheStats.evictions, cacheStats.evictedBlocks,
+			cacheStats.smcInvalidations, cacheStats.flushes, cacheStats.asyncCompiles, cacheStats.interpreted);
+}
+
 void clear_temp_cache(bool full)
 {
 	//printf("recSh4:Temp Code Cache clear at %08X\n", curr_pc);
@@ -58,20 +121,34 @@ void clear_temp_cache(bool full)
 static void recSh4_ClearCache()
 {
 	INFO_LOG(DYNAREC, "recSh4:Dynarec Cache clear at %08X free space %d", next_pc, emit_FreeSpace());
+	cacheStats.flushes++;
+	logCacheStats();
 	LastAddr=LastAddr_min;
+	blockoptimizer::reset();
 	bm_ResetCache();
+	resetRegions();
 	smc_hotspots.clear();
 	clear_temp_cache(true);
 }
 
+// Evicts the blocks of the next region and makes it the current one
+static void recSh4_EvictRegion()
+{
+	currentRegion = (currentRegion + 1) % CODE_REGIONS;
+	u32 start = regionStart(currentRegion);
+	u32 count = bm_DiscardBlocks(&CodeCache[start], &CodeCache[regionEnd(currentRegion)]);
+	LastAddr = start;
+	cacheStats.evictions++;
+	cacheStats.evictedBlocks += count;
+	DEBUG_LOG(DYNAREC, "recSh4:Code cache region %d evicted at %08X: %d blocks", currentRegion, next_pc, count);
+}
+
 static void recSh4_Run()
 {
-	sh4_int_bCpuRun = true;
 	RestoreHostRoundingMode();
 
 	sh4_dyna_rcb=(u8*)&Sh4cntx + sizeof(Sh4cntx);
-	INFO_LOG(DYNAREC, "cntx // fpcb offset: %td // pc offset: %td // pc %08X", (u8*)&sh4rcb.fpcb - sh4_dyna_rcb, (u8*)&sh4rcb.cntx.pc - sh4_dyna_rcb, sh4rcb.cntx.pc);
-	
+
 	ngen_mainloop(sh4_dyna_rcb);
 
 	sh4_int_bCpuRun = false;
@@ -104,12 +181,12 @@ u32 emit_FreeSpace()
 	if (emit_ptr)
 		return (emit_ptr_limit - emit_ptr) * sizeof(u32);
 	else
-		return CODE_SIZE - LastAddr;
+		return regionEnd(currentRegion) - LastAddr;
 }
 
 void AnalyseBlock(RuntimeBlockInfo* blk);
 
-static char block_hash[1024];
+static thread_local char block_hash[1024];
 
 const char* RuntimeBlockInfo::hash()
 {
@@ -139,12 +216,17 @@ const char* RuntimeBlockInfo::hash()
 	return block_hash;
 }
 
-bool RuntimeBlockInfo::Setup(u32 rpc,fpscr_t rfpu_cfg)
+void RuntimeBlockInfo::Reset()
 {
+	static u32 nextId;
+	id = ++nextId;
 	staging_runs=addr=lookups=runs=host_code_size=0;
 	guest_cycles=guest_opcodes=host_opcodes=0;
 	sh4_code_size = 0;
+	relink_offset = relink_data = 0;
 	pBranchBlock=pNextBlock=0;
+	// Recycled blocks may still have predecessors from their previous use
+	pre_refs.clear();
 	code=0;
 	has_jcond=false;
 	BranchBlock = NullAddress;
@@ -152,7 +234,13 @@ bool RuntimeBlockInfo::Setup(u32 rpc,fpscr_t rfpu_cfg)
 	BlockType = BET_SCL_Intr;
 	has_fpu_op = false;
 	temp_block = false;
-	
+	optimized = false;
+}
+
+bool RuntimeBlockInfo::Setup(u32 rpc,fpscr_t rfpu_cfg,bool optimise)
+{
+	Reset();
+
 	vaddr = rpc;
 	if (mmu_enabled())
 	{
@@ -169,10 +257,18 @@ bool RuntimeBlockInfo::Setup(u32 rpc,fpscr_t rfpu_cfg)
 	
 	oplist.clear();
 
+	if (blockcache::lookup(this))
+	{
+		// Already decoded and optimized
+		SetProtectedFlags();
+		optimized = true;
+		return true;
+	}
+
 #if !defined(NO_MMU)
 	try {
 #endif
-		if (!dec_DecodeBlock(this, SH4_TIMESLICE / 2))
+		if (!dec_DecodeBlock(this, SH4_TIMESLICE / 2, optimise && config::DynarecSuperblocks))
 			return false;
 #if !defined(NO_MMU)
 	}
@@ -183,26 +279,60 @@ bool RuntimeBlockInfo::Setup(u32 rpc,fpscr_t rfpu_cfg)
 #endif
 	SetProtectedFlags();
 
-	AnalyseBlock(this);
+	if (optimise)
+	{
+		AnalyseBlock(this);
+		blockcache::store(this);
+		optimized = true;
+	}
 
 	return true;
 }
 
-DynarecCodeEntryPtr rdv_CompilePC(u32 blockcheck_failures)
+void RuntimeBlockInfo::SetupCopy(const RuntimeBlockInfo& staging)
 {
-	u32 pc=next_pc;
-
-	if (emit_FreeSpace()<16*1024 || pc==0x8c0000e0 || pc==0xac010000 || pc==0xac008300)
-		recSh4_ClearCache();
-
-	RuntimeBlockInfo* rbi = ngen_AllocateBlock();
+	Reset();
+	vaddr = staging.vaddr;
+	addr = staging.addr;
+	fpu_cfg = staging.fpu_cfg;
+	blockcheck_failures = staging.blockcheck_failures;
+	// Staging blocks don't follow branches. Superblocks only span the pages of their first block,
+	// which are write-protected since the staging block is.
+	if (config::DynarecSuperblocks && staging.read_only && sr.FD == 0
+			&& (staging.BlockType == BET_StaticJump || staging.BlockType == BET_StaticCall))
+	{
+		oplist.clear();
+		bool rc = dec_DecodeBlock(this, SH4_TIMESLICE / 2, true);
+		verify(rc);
+		read_only = true;
+		return;
+	}
+	sh4_code_size = staging.sh4_code_size;
+	guest_cycles = staging.guest_cycles;
+	guest_opcodes = staging.guest_opcodes;
+	BlockType = staging.BlockType;
+	BranchBlock = staging.BranchBlock;
+	NextBlock = staging.NextBlock;
+	has_fpu_op = staging.has_fpu_op;
+	has_jcond = staging.has_jcond;
+	read_only = staging.read_only;
+	oplist = staging.oplist;
+}
 
-	if (!rbi->Setup(pc,fpscr))
+static void reserveCodeSpace()
+{
+	if (emit_FreeSpace()<16*1024)
 	{
-		delete rbi;
-		return NULL;
+		if (CODE_REGIONS == 1)
+			recSh4_ClearCache();
+		else
+			recSh4_EvictRegion();
 	}
-	rbi->blockcheck_failures = blockcheck_failures;
+}
+
+// Generates the host code of a decoded block and adds it to the block manager
+static DynarecCodeEntryPtr emitBlock(RuntimeBlockInfo* rbi)
+{
 	if (smc_hotspots.find(rbi->addr) != smc_hotspots.end())
 	{
 		if (TEMP_CODE_SIZE - TempLastAddr < 16 * 1024)
@@ -214,9 +344,11 @@ DynarecCodeEntryPtr rdv_CompilePC(u32 blockcheck_failures)
 			INFO_LOG(DYNAREC, "WARNING: temp block %x (%x) is protected!", rbi->vaddr, rbi->addr);
 	}
 	bool do_opts = !rbi->temp_block;
-	rbi->staging_runs=do_opts?100:-100;
+	// Temp blocks are recompiled too often to be worth optimizing
+	bool staging = do_opts && !rbi->optimized;
+	rbi->staging_runs = staging ? HotBlockRuns : -100;
 	bool block_check = !rbi->read_only;
-	ngen_Compile(rbi, block_check, (pc & 0xFFFFFF) == 0x08300 || (pc & 0xFFFFFF) == 0x10000, false, do_opts);
+	ngen_Compile(rbi, block_check, (rbi->vaddr & 0xFFFFFF) == 0x08300 || (rbi->vaddr & 0xFFFFFF) == 0x10000, staging, do_opts);
 	verify(rbi->code!=0);
 
 	bm_AddBlock(rbi);
@@ -231,6 +363,37 @@ DynarecCodeEntryPtr rdv_CompilePC(u32 blockcheck_failures)
 	return rbi->code;
 }
 
+// hot is true when recompiling a block that has run HotBlockRuns times
+// Decodes the block synchronously. See rdv_CompileOrInterpret for the background decoding.
+static DynarecCodeEntryPtr compileBlock(u32 blockcheck_failures, bool hot)
+{
+	u32 pc=next_pc;
+
+	if (pc==0x8c0000e0 || pc==0xac010000 || pc==0xac008300)
+		recSh4_ClearCache();
+	else
+		reserveCodeSpace();
+
+	RuntimeBlockInfo* rbi = bm_AllocateBlock();
+
+	if (!rbi->Setup(pc, fpscr, hot || !TieredCompilation))
+	{
+		bm_FreeBlock(rbi);
+		return NULL;
+	}
+	rbi->blockcheck_failures = blockcheck_failures;
+	cacheStats.compiles++;
+	if (!compiledBlocks.insert(rbi->addr).second && !hot)
+		cacheStats.recompiles++;
+
+	return emitBlock(rbi);
+}
+
+DynarecCodeEntryPtr rdv_CompilePC(u32 blockcheck_failures)
+{
+	return compileBlock(blockcheck_failures, false);
+}
+
 DynarecCodeEntryPtr DYNACALL rdv_FailedToFindBlock_pc()
 {
 	return rdv_FailedToFindBlock(next_pc);
@@ -271,32 +434,131 @@ u32 DYNACALL rdv_DoInterrupts(void* block_cpde)
 DynarecCodeEntryPtr DYNACALL rdv_BlockCheckFail(u32 addr)
 {
 	DEBUG_LOG(DYNAREC, "rdv_BlockCheckFail @ %08x", addr);
-	u32 blockcheck_failures = 0;
-	if (mmu_enabled())
+	if (!mmu_enabled())
+		next_pc = addr;
+	// Only the modified block is invalidated. Other blocks have their own checks or are write-protected.
+	RuntimeBlockInfoPtr block = bm_GetBlock(addr);
+	u32 blockcheck_failures = block->blockcheck_failures + 1;
+	if (TEMP_CODE_SIZE != 0 && blockcheck_failures > 5)
 	{
-		RuntimeBlockInfoPtr block = bm_GetBlock(addr);
-		blockcheck_failures = block->blockcheck_failures + 1;
-		if (blockcheck_failures > 5)
+		bool inserted = smc_hotspots.insert(addr).second;
+		if (inserted)
+			DEBUG_LOG(DYNAREC, "rdv_BlockCheckFail SMC hotspot @ %08x fails %d", addr, blockcheck_failures);
+	}
+	bm_DiscardBlock(block);
+	cacheStats.smcInvalidations++;
+
+	return (DynarecCodeEntryPtr)CC_RW2RX(rdv_CompilePC(blockcheck_failures));
+}
+
+// addr must be the physical address of the start of the block
+DynarecCodeEntryPtr DYNACALL rdv_BlockHot(u32 addr)
+{
+	if (!mmu_enabled())
+		next_pc = addr;
+	RuntimeBlockInfoPtr block = bm_GetBlock(addr);
+	if (!mmu_enabled())
+	{
+		// The block is optimized by a worker thread. Keep running the staging block until it's done.
+		RuntimeBlockInfo* optimized = blockoptimizer::getOptimized(block);
+		if (optimized == nullptr)
+		{
+			block->staging_runs = HotBlockRuns;
+			return (DynarecCodeEntryPtr)CC_RW2RX(block->code);
+		}
+		// The staging block being live, its guest code hasn't changed. Its protection should be the same too.
+		if (bm_CanProtectBlock(optimized->addr, optimized->sh4_code_size) == optimized->read_only)
 		{
-			bool inserted = smc_hotspots.insert(addr).second;
-			if (inserted)
-				DEBUG_LOG(DYNAREC, "rdv_BlockCheckFail SMC hotspot @ %08x fails %d", addr, blockcheck_failures);
+			bm_DiscardBlock(block);
+			cacheStats.promotions++;
+			reserveCodeSpace();
+			optimized->SetProtectedFlags();
+			blockcache::store(optimized);
+
+			return (DynarecCodeEntryPtr)CC_RW2RX(emitBlock(optimized));
 		}
-		bm_DiscardBlock(block.get());
+		bm_FreeBlock(optimized);
 	}
-	else
+	u32 blockcheck_failures = block->blockcheck_failures;
+	bm_DiscardBlock(block);
+	cacheStats.promotions++;
+
+	return (DynarecCodeEntryPtr)CC_RW2RX(compileBlock(blockcheck_failures, true));
+}
+
+// Missed blocks are decoded by a worker thread and interpreted until they're ready
+static bool asyncCompile()
+{
+	return AsyncCompileSupported && config::DynarecAsyncCompile && !mmu_enabled();
+}
+
+// Returns the block at pc set up from the persistent block cache, or null
+static RuntimeBlockInfo *lookupBlockCache(u32 pc)
+{
+	RuntimeBlockInfo *block = bm_AllocateBlock();
+	block->Reset();
+	block->vaddr = pc;
+	block->addr = pc;
+	block->fpu_cfg = fpscr;
+	block->oplist.clear();
+	if (!blockcache::lookup(block))
 	{
-		next_pc = addr;
-		recSh4_ClearCache();
+		bm_FreeBlock(block);
+		return nullptr;
 	}
-	return (DynarecCodeEntryPtr)CC_RW2RX(rdv_CompilePC(blockcheck_failures));
+	block->optimized = true;
+	return block;
+}
+
+u32 DYNACALL rdv_CompileOrInterpret()
+{
+	u32 pc = next_pc;
+	// The first blocks flush the code cache, and the decoder may raise an fpu disabled exception
+	if (!asyncCompile() || pc == 0x8c0000e0 || pc == 0xac010000 || pc == 0xac008300 || sr.FD == 1)
+	{
+		rdv_FailedToFindBlock(pc);
+		return 0;
+	}
+	RuntimeBlockInfo *block = nullptr;
+	if (config::DynarecBlockCache && !blockoptimizer::isDecoding(pc))
+		block = lookupBlockCache(pc);
+	if (block == nullptr)
+	{
+		if (!blockoptimizer::getDecoded(pc, fpscr, block))
+		{
+			rdv_FailedToFindBlock(pc);
+			return 0;
+		}
+		if (block == nullptr)
+		{
+			// Still being decoded
+			cacheStats.interpreted++;
+			return Sh4_int_RunBlock(SH4_TIMESLICE / 2);
+		}
+		cacheStats.asyncCompiles++;
+	}
+	block->blockcheck_failures = 0;
+	cacheStats.compiles++;
+	if (!compiledBlocks.insert(block->addr).second)
+		cacheStats.recompiles++;
+	reserveCodeSpace();
+	block->SetProtectedFlags();
+	emitBlock(block);
+
+	return 0;
 }
 
 DynarecCodeEntryPtr rdv_FindOrCompile()
 {
 	DynarecCodeEntryPtr rv = bm_GetCodeByVAddr(next_pc);  // Returns exec addr
 	if (rv == ngen_FailedToFindBlock)
-		rv = (DynarecCodeEntryPtr)CC_RW2RX(rdv_CompilePC(0));  // Returns rw addr
+	{
+		// ngen_FailedToFindBlock compiles or interprets the block
+		if (!asyncCompile())
+			rv = (DynarecCodeEntryPtr)CC_RW2RX(rdv_CompilePC(0));  // Returns rw addr
+	}
+	else
+		cacheStats.hits++;
 	
 	return rv;
 }
@@ -337,8 +599,15 @@ void* DYNACALL rdv_LinkBlock(u8* code,u32 dpc)
 	}
 
 	DynarecCodeEntryPtr rv = rdv_FindOrCompile();  // Returns rx ptr
+	// Compiling the next block may have flushed the code cache
+	if (!stale_block && bm_GetBlock(code) != rbi)
+		stale_block = true;
 
-	if (!mmu_enabled() && !stale_block)
+	if (rv == ngen_FailedToFindBlock)
+	{
+		// Not compiled yet. It will be linked the next time.
+	}
+	else if (!mmu_enabled() && !stale_block)
 	{
 		if (bcls == BET_CLS_Dynamic)
 		{
@@ -352,13 +621,13 @@ void* DYNACALL rdv_LinkBlock(u8* code,u32 dpc)
 			}
 			else if (rbi->relink_data == 0)
 			{
-				rbi->pBranchBlock = bm_GetBlock(next_pc).get();
+				rbi->pBranchBlock = bm_GetBlock(next_pc);
 				rbi->pBranchBlock->AddRef(rbi);
 			}
 		}
 		else
 		{
-			RuntimeBlockInfo* nxt = bm_GetBlock(next_pc).get();
+			RuntimeBlockInfo* nxt = bm_GetBlock(next_pc);
 
 			if (rbi->BranchBlock == next_pc)
 				rbi->pBranchBlock = nxt;
@@ -378,6 +647,11 @@ void* DYNACALL rdv_LinkBlock(u8* code,u32 dpc)
 	
 	return (void*)rv;
 }
+static void recSh4_Start()
+{
+	sh4Interp.Start();
+}
+
 static void recSh4_Stop()
 {
 	sh4Interp.Stop();
@@ -392,6 +666,11 @@ static void recSh4_Reset(bool hard)
 {
 	sh4Interp.Reset(hard);
 	recSh4_ClearCache();
+	if (hard)
+	{
+		cacheStats = {};
+		compiledBlocks.clear();
+	}
 }
 
 static void recSh4_Init()
@@ -400,6 +679,7 @@ static void recSh4_Init()
 	Get_Sh4Interpreter(&sh4Interp);
 	sh4Interp.Init();
 	bm_Init();
+	blockoptimizer::init();
 
 	
 	if (_nvmem_enabled())
@@ -431,11 +711,14 @@ static void recSh4_Init()
 	TempCodeCache = CodeCache + CODE_SIZE;
 	ngen_init();
 	bm_ResetCache();
+	resetRegions();
 }
 
 static void recSh4_Term()
 {
 	INFO_LOG(DYNAREC, "recSh4 Term");
+	logCacheStats();
+	blockoptimizer::term();
 	bm_Term();
 	sh4Interp.Term();
 }
@@ -447,6 +730,7 @@ static bool recSh4_IsCpuRunning()
 
 void Get_Sh4Recompiler(sh4_if* cpu)
 {
+	cpu->Start = recSh4_Start;
 	cpu->Run = recSh4_Run;
 	cpu->Stop = recSh4_Stop;
 	cpu->Step = recSh4_Step;
@@ -85,10 +85,15 @@ DynarecCodeEntryPtr DYNACALL rdv_FailedToFindBlock(u32 pc);
 DynarecCodeEntryPtr DYNACALL rdv_FailedToFindBlock_pc();
 //Called when a block check failed, and the block needs to be invalidated
 DynarecCodeEntryPtr DYNACALL rdv_BlockCheckFail(u32 addr);
+//Called when a staging block has run enough times, to recompile it with optimizations
+DynarecCodeEntryPtr DYNACALL rdv_BlockHot(u32 addr);
 //Called to compile code @pc
 DynarecCodeEntryPtr rdv_CompilePC(u32 blockcheck_failures);
 //Finds or compiles code @pc
 DynarecCodeEntryPtr rdv_FindOrCompile();
+//Called from ngen_FailedToFindBlock by the backends supporting background compilation
+//Compiles the block @next_pc if it's ready, or interprets it. Returns the cycles used.
+u32 DYNACALL rdv_CompileOrInterpret();
 
 //code -> pointer to code of block, dpc -> if dynamic block, pc. if cond, 0 for next, 1 for branch
 void* DYNACALL rdv_LinkBlock(u8* code,u32 dpc);
@@ -101,9 +106,12 @@ u32 DYNACALL rdv_DoInterrupts_pc(u32 pc);
 void ngen_init();
 
 //Called to compile a block
+//If smc_checks is set, the block must check that its guest code hasn't changed and call rdv_BlockCheckFail otherwise
+//If staging is set, the block must decrement its staging_runs at each run and call rdv_BlockHot when it reaches 0
 void ngen_Compile(RuntimeBlockInfo* block, bool smc_checks, bool reset, bool staging, bool optimise);
 
-//Called when blocks are reseted
+//Called when blocks are reseted, before any block is allocated
+//Must emit the main loop and stubs that live in the code cache: the code cache regions start after them
 void ngen_ResetBlocks();
 //Value to be returned when the block manager failed to find a block,
 //should call rdv_FailedToFindBlock and then jump to the return value
@@ -137,3 +145,19 @@ RuntimeBlockInfo* ngen_AllocateBlock();
 #ifdef __cplusplus
 }
 #endif
+
+// Code cache statistics, to help sizing CODE_SIZE
+struct DynarecCacheStats
+{
+	u64 compiles;
+	u64 recompiles;			// blocks compiled again after being evicted or invalidated
+	u64 promotions;			// staging blocks recompiled with optimizations
+	u64 hits;				// block lookups finding compiled code
+	u64 evictions;			// code cache regions evicted
+	u64 evictedBlocks;
+	u64 smcInvalidations;	// blocks invalidated by a failed block check
+	u64 flushes;			// full code cache clears
+	u64 asyncCompiles;		// blocks decoded in the background
+	u64 interpreted;		// blocks interpreted while being decoded in the background
+};
+const DynarecCacheStats& rdv_GetCacheStats();
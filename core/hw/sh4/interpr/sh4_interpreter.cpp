@@ -37,9 +37,13 @@ static u16 ReadNexOp()
 	return IReadMem16(addr);
 }
 
-static void Sh4_int_Run()
+static void Sh4_int_Start()
 {
 	sh4_int_bCpuRun = true;
+}
+
+static void Sh4_int_Run()
+{
 	RestoreHostRoundingMode();
 
 	l += SH4_TIMESLICE;
@@ -99,6 +103,35 @@ static void Sh4_int_Step()
 	}
 }
 
+// Runs the code at next_pc until the end of its basic block, a write to sr or fpscr, or until max_cycles ops have run.
+// Used by the dynarec while a block is compiled in the background.
+// Returns the cycles used, counted like the dynarec counts the cycles of its blocks.
+int Sh4_int_RunBlock(int max_cycles)
+{
+	int cycles = 0;
+#if !defined(NO_MMU)
+	try {
+#endif
+		do
+		{
+			u32 op = ReadNexOp();
+			if (sr.FD == 1 && OpDesc[op]->IsFloatingPoint())
+				RaiseFPUDisableException();
+			OpPtr[op](op);
+			cycles++;
+			if (OpDesc[op]->SetPC() || OpDesc[op]->SetSR() || OpDesc[op]->SetFPSCR())
+				break;
+		} while (cycles < max_cycles);
+#if !defined(NO_MMU)
+	}
+	catch (SH4ThrownException& ex) {
+		Do_Exception(ex.epc, ex.expEvn, ex.callVect);
+		cycles += 5;
+	}
+#endif
+	return cycles;
+}
+
 static void Sh4_int_Reset(bool hard)
 {
 	verify(!sh4_int_bCpuRun);
@@ -203,6 +236,7 @@ static void Sh4_int_Term()
 
 void Get_Sh4Interpreter(sh4_if* cpu)
 {
+	cpu->Start = Sh4_int_Start;
 	cpu->Run = Sh4_int_Run;
 	cpu->Stop = Sh4_int_Stop;
 	cpu->Step = Sh4_int_Step;
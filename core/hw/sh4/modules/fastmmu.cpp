@@ -42,6 +42,8 @@ const TLB_Entry *lru_entry = NULL;
 static u32 lru_mask;
 static u32 lru_address;
 
+MmuTlbEntry mmuTlb[MMU_TLB_SIZE];
+
 struct TLB_LinkedEntry {
 	TLB_Entry entry;
 	TLB_LinkedEntry *next_entry;
@@ -190,6 +192,7 @@ bool UTLB_Sync(u32 entry)
 
 	tlb_entry.Address.VPN = lru_address >> 10;
 	cache_entry(tlb_entry);
+	mmu_tlb_invalidate(lru_address, ~lru_mask + 1);
 
 	if (!mmu_enabled() && (tlb_entry.Address.VPN & (0xFC000000 >> 10)) == (0xE0000000 >> 10))
 	{
@@ -344,5 +347,50 @@ void mmu_flush_table()
 {
 	lru_entry = NULL;
 	flush_cache();
+	mmu_tlb_flush();
+}
+
+void mmu_tlb_add(u32 va, u32 pa)
+{
+	// Only system RAM, which has no side effects and can be accessed directly
+	if (!_nvmem_enabled() || (pa >> 29) == 7 || (pa & 0x1C000000) != 0x0C000000)
+		return;
+	// A 4 KB page may hold several 1 KB pages mapped to different addresses
+	if (fast_reg_lut[va >> 29] == 0 && (va & 0xFC000000) != 0x7C000000 && (lru_mask & 0xC00) != 0)
+		return;
+	u32 page = va & ~0xFFF;
+	MmuTlbEntry& entry = mmuTlb[mmu_tlb_index(va, CCN_PTEH.ASID)];
+	entry.tag = page | CCN_PTEH.ASID;
+	entry.offset = (uintptr_t)&mem_b.data[pa & RAM_MASK & ~0xFFF] - page;
+}
+
+void mmu_tlb_invalidate(u32 va, u32 size)
+{
+	u32 start = va & ~0xFFF;
+	u32 pages = std::max(size >> 12, 1u);
+	if (pages * 256 > MMU_TLB_SIZE)
+	{
+		for (MmuTlbEntry& entry : mmuTlb)
+			if ((entry.tag & ~0xFFF) - start < pages * 0x1000)
+				entry.tag = MMU_TLB_INVALID;
+		return;
+	}
+	// The page may be cached for any ASID
+	for (u32 i = 0; i < pages; i++)
+	{
+		u32 page = start + i * 0x1000;
+		for (u32 asid = 0; asid < 256; asid++)
+		{
+			MmuTlbEntry& entry = mmuTlb[mmu_tlb_index(page, asid)];
+			if (entry.tag == (page | asid))
+				entry.tag = MMU_TLB_INVALID;
+		}
+	}
+}
+
+void mmu_tlb_flush()
+{
+	for (MmuTlbEntry& entry : mmuTlb)
+		entry.tag = MMU_TLB_INVALID;
 }
 #endif 	// FAST_MMU
@@ -108,6 +108,29 @@ bool mmu_is_translated(u32 va, u32 size)
 	return true;
 }
 
+#ifdef FAST_MMU
+// Direct-mapped cache of the 4 KB virtual pages translated to system RAM.
+// Probed inline by the x64 dynarec memory handlers before doing a full translation.
+struct MmuTlbEntry
+{
+	u32 tag;			// virtual page address | ASID
+	uintptr_t offset;	// host address of the page minus its virtual address
+};
+constexpr u32 MMU_TLB_SIZE = 1024;
+constexpr u32 MMU_TLB_INVALID = 0xF00;	// never matches a page address | ASID
+extern MmuTlbEntry mmuTlb[MMU_TLB_SIZE];
+
+// Shared pages accessed with different ASIDs don't evict each other
+static inline u32 mmu_tlb_index(u32 va, u32 asid) {
+	return ((va >> 12) ^ asid) & (MMU_TLB_SIZE - 1);
+}
+
+// Caches the translation of va to pa if pa is in system RAM
+void mmu_tlb_add(u32 va, u32 pa);
+void mmu_tlb_invalidate(u32 va, u32 size);
+void mmu_tlb_flush();
+#endif
+
 #if defined(NO_MMU)
 	bool inline mmu_TranslateSQW(u32 addr, u32* mapped) {
 		*mapped = sq_remap[(addr>>20)&0x3F] | (addr & 0xFFFE0);
@@ -136,6 +159,9 @@ bool mmu_is_translated(u32 va, u32 size)
 		else
 		{
 			*exception_occurred = 0;
+#ifdef FAST_MMU
+			mmu_tlb_add(adr, addr);
+#endif
 			return _vmem_readt<T, T>(addr);
 		}
 	}
@@ -150,6 +176,9 @@ bool mmu_is_translated(u32 va, u32 size)
 			DoMMUException(adr, rv, MMU_TT_DWRITE);
 			return 1;
 		}
+#ifdef FAST_MMU
+		mmu_tlb_add(adr, addr);
+#endif
 		_vmem_writet<T>(addr, data);
 		return 0;
 	}
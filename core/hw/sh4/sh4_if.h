@@ -219,6 +219,7 @@ struct fpscr_t
 //sh4 interface
 struct sh4_if
 {
+	void (*Start)();	// must be called before Run(). Stop() can be called any time after.
 	void (*Run)();
 	void (*Stop)();
 	void (*Step)();
@@ -40,6 +40,7 @@ enum OpcodeType
 
 void ExecuteDelayslot();
 void ExecuteDelayslot_RTE();
+int Sh4_int_RunBlock(int max_cycles);
 
 #define SH4_TIMESLICE 448	// at 112 Bangai-O doesn't start. 224 is ok
 							// at 448 Gundam Side Story hangs on Sega copyright screen, 224 ok, 672 ok(!)
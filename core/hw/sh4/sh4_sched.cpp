@@ -5,6 +5,9 @@
 #include "sh4_sched.h"
 #include "oslib/oslib.h"
 
+#include <algorithm>
+#include <functional>
+
 
 //sh4 scheduler
 
@@ -28,6 +31,102 @@ std::vector<sched_list> sch_list;	// using list as external inside a macro confu
 
 int sh4_sched_next_id=-1;
 
+/*
+	Enabled events are kept in a binary min-heap ordered by their 64-bit expiry time,
+	then by id. sch_list stays the reference state (it is saved in savestates),
+	and the heap is rebuilt from it by sh4_sched_ffts().
+*/
+static std::vector<u64> sch_expiry;
+static std::vector<int> sch_heap;
+static std::vector<int> sch_heap_pos;	// -1 if the event isn't in the heap
+
+// Events expiring during the current tick, ordered by id
+static std::vector<int> sch_due;
+static bool sch_ticking;
+static int sch_cursor;
+static u64 sch_tick_start;
+static u32 sch_tick_cycles;
+
+static bool sch_before(int a, int b)
+{
+	return sch_expiry[a] < sch_expiry[b] || (sch_expiry[a] == sch_expiry[b] && a < b);
+}
+
+static void sch_heap_set(size_t pos, int id)
+{
+	sch_heap[pos] = id;
+	sch_heap_pos[id] = pos;
+}
+
+static void sch_sift_up(size_t pos)
+{
+	int id = sch_heap[pos];
+	while (pos > 0)
+	{
+		size_t parent = (pos - 1) / 2;
+		if (!sch_before(id, sch_heap[parent]))
+			break;
+		sch_heap_set(pos, sch_heap[parent]);
+		pos = parent;
+	}
+	sch_heap_set(pos, id);
+}
+
+static void sch_sift_down(size_t pos)
+{
+	int id = sch_heap[pos];
+	for (;;)
+	{
+		size_t child = pos * 2 + 1;
+		if (child >= sch_heap.size())
+			break;
+		if (child + 1 < sch_heap.size() && sch_before(sch_heap[child + 1], sch_heap[child]))
+			child++;
+		if (!sch_before(sch_heap[child], id))
+			break;
+		sch_heap_set(pos, sch_heap[child]);
+		pos = child;
+	}
+	sch_heap_set(pos, id);
+}
+
+static void sch_heap_remove(int id)
+{
+	int pos = sch_heap_pos[id];
+	if (pos == -1)
+		return;
+	sch_heap_pos[id] = -1;
+	int last = sch_heap.back();
+	sch_heap.pop_back();
+	if (last != id)
+	{
+		sch_heap_set(pos, last);
+		sch_sift_up(pos);
+		sch_sift_down(sch_heap_pos[last]);
+	}
+}
+
+// To be called after the expiry time of an event has changed
+static void sch_heap_update(int id)
+{
+	int pos = sch_heap_pos[id];
+	if (pos == -1)
+	{
+		sch_heap.push_back(id);
+		sch_sift_up(sch_heap.size() - 1);
+	}
+	else
+	{
+		sch_sift_up(pos);
+		sch_sift_down(sch_heap_pos[id]);
+	}
+}
+
+static bool sch_is_due(int id)
+{
+	return sch_list[id].end != -1 && sch_expiry[id] - sch_tick_start <= sch_tick_cycles;
+}
+
 u32 sh4_sched_remaining(size_t id, u32 reference)
 {
 	if (sch_list[id].end != -1)
@@ -41,36 +140,50 @@ u32 sh4_sched_remaining(size_t id)
 	return sh4_sched_remaining(id, sh4_sched_now());
 }
 
-void sh4_sched_ffts()
+static void sh4_sched_update_next()
 {
-	u32 diff=-1;
-	int slot=-1;
+	sh4_sched_ffb-=Sh4cntx.sh4_sched_next;
 
-	for (size_t i=0;i<sch_list.size();i++)
+	if (sch_heap.empty())
 	{
-		if (sh4_sched_remaining(i)<diff)
-		{
-			slot=i;
-			diff=sh4_sched_remaining(i);
-		}
+		sh4_sched_next_id=-1;
+		Sh4cntx.sh4_sched_next=SH4_MAIN_CLOCK;
 	}
-
-	sh4_sched_ffb-=Sh4cntx.sh4_sched_next;
-
-	sh4_sched_next_id=slot;
-	if (slot!=-1)
-		Sh4cntx.sh4_sched_next=diff;
 	else
-		Sh4cntx.sh4_sched_next=SH4_MAIN_CLOCK;
+	{
+		sh4_sched_next_id=sch_heap[0];
+		// sh4_sched_ffb is the current time here. Events may be overdue while ticking.
+		s64 diff = (s64)(sch_expiry[sh4_sched_next_id] - sh4_sched_ffb);
+		Sh4cntx.sh4_sched_next=std::max<s64>(diff, 0);
+	}
 
 	sh4_sched_ffb+=Sh4cntx.sh4_sched_next;
 }
 
+void sh4_sched_ffts()
+{
+	// Rebuild the heap from sch_list, which may have been modified by a savestate
+	u64 now = sh4_sched_now64();
+	sch_expiry.resize(sch_list.size());
+	sch_heap_pos.assign(sch_list.size(), -1);
+	sch_heap.clear();
+	for (size_t i=0;i<sch_list.size();i++)
+	{
+		if (sch_list[i].end == -1)
+			continue;
+		sch_expiry[i] = now + sh4_sched_remaining(i);
+		sch_heap_update(i);
+	}
+	sh4_sched_update_next();
+}
+
 int sh4_sched_register(int tag, sh4_sched_callback* ssc)
 {
 	sched_list t={ssc,tag,-1,-1};
 
 	sch_list.push_back(t);
+	sch_expiry.push_back(0);
+	sch_heap_pos.push_back(-1);
 
 	return sch_list.size()-1;
 }
@@ -99,15 +212,24 @@ void sh4_sched_request(size_t id, int cycles)
 	if (cycles == -1)
 	{
 		sch_list[id].end = -1;
+		sch_heap_remove(id);
 	}
 	else
 	{
 		sch_list[id].end = sch_list[id].start + cycles;
 		if (sch_list[id].end == -1)
 			sch_list[id].end++;
+		sch_expiry[id] = sh4_sched_now64() + (u32)(sch_list[id].end - sch_list[id].start);
+		sch_heap_update(id);
+		// Events not visited yet by the current tick must be handled by it if they expire in time
+		if (sch_ticking && (int)id > sch_cursor && sch_is_due(id))
+		{
+			sch_due.push_back(id);
+			std::push_heap(sch_due.begin(), sch_due.end(), std::greater<int>());
+		}
 	}
 
-	sh4_sched_ffts();
+	sh4_sched_update_next();
 }
 
 /* Returns how much time has passed for this callback */
@@ -130,12 +252,27 @@ static void handle_cb(size_t id)
 	int jitter=elapsd-remain;
 
 	sch_list[id].end=-1;
+	sch_heap_remove(id);
 	int re_sch=sch_list[id].cb(sch_list[id].tag,remain,jitter);
 
 	if (re_sch > 0)
 		sh4_sched_request(id, std::max(0, re_sch - jitter));
 }
 
+// Collects the events of the heap subtree at pos that expire in the current tick
+static void sch_collect_due(size_t pos)
+{
+	if (pos >= sch_heap.size())
+		return;
+	int id = sch_heap[pos];
+	if (sch_expiry[id] > sch_tick_start + sch_tick_cycles)
+		return;
+	if (sch_is_due(id))
+		sch_due.push_back(id);
+	sch_collect_due(pos * 2 + 1);
+	sch_collect_due(pos * 2 + 2);
+}
+
 void sh4_sched_tick(int cycles)
 {
 	/*
@@ -145,17 +282,30 @@ void sh4_sched_tick(int cycles)
 
 	if (Sh4cntx.sh4_sched_next<0)
 	{
-		u32 fztime=sh4_sched_now()-cycles;
 		if (sh4_sched_next_id!=-1)
 		{
-			for (size_t i = 0; i < sch_list.size(); i++)
+			// Expired events are handled in id order, as if all the events were polled
+			// in turn at the end of the tick.
+			sch_tick_start = sh4_sched_now64() - cycles;
+			sch_tick_cycles = cycles;
+			sch_due.clear();
+			sch_collect_due(0);
+			std::make_heap(sch_due.begin(), sch_due.end(), std::greater<int>());
+			sch_cursor = -1;
+			sch_ticking = true;
+			while (!sch_due.empty())
 			{
-				u32 remaining = sh4_sched_remaining(i, fztime);
-				verify(remaining >= 0 || remaining == -1);
-				if (remaining >= 0 && remaining <= (u32)cycles)
-					handle_cb(i);
+				std::pop_heap(sch_due.begin(), sch_due.end(), std::greater<int>());
+				int id = sch_due.back();
+				sch_due.pop_back();
+				// skip duplicates and events cancelled or rescheduled by previous callbacks
+				if (id <= sch_cursor || !sch_is_due(id))
+					continue;
+				sch_cursor = id;
+				handle_cb(id);
 			}
+			sch_ticking = false;
 		}
-		sh4_sched_ffts();
+		sh4_sched_update_next();
 	}
 }
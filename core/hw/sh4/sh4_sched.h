@@ -42,6 +42,10 @@ void sh4_sched_request(size_t id, int cycles);
 */
 void sh4_sched_tick(int cycles);
 
+/*
+	Rebuild the scheduler state from sch_list.
+	Must be called after sch_list has been modified (savestate loading)
+*/
 void sh4_sched_ffts();
 
 struct sched_list
@@ -1,7 +1,11 @@
 #include "common.h"
+#include "hunkcache.h"
+#include "cfg/option.h"
 
 #include "deps/chdr/chd.h"
 
+#include <memory>
+
 /* tracks are padded to a multiple of this many frames */
 const uint32_t CD_TRACK_PADDING = 4;
 
@@ -9,8 +13,7 @@ struct CHDDisc : Disc
 {
 	chd_file *chd = nullptr;
 	FILE *fp = nullptr;
-	u8* hunk_mem = nullptr;
-	u32 old_hunk = 0;
+	std::unique_ptr<HunkCache> cache;
 
 	u32 hunkbytes = 0;
 	u32 sph = 0;
@@ -19,7 +22,8 @@ struct CHDDisc : Disc
 
 	~CHDDisc() override
 	{
-		delete[] hunk_mem;
+		// stop the read-ahead thread before closing the file
+		cache.reset();
 
 		if (chd)
 			chd_close(chd);
@@ -49,15 +53,10 @@ struct CHDTrack : TrackFile
 	{
 		u32 fad_offs = FAD + Offset;
 		u32 hunk=(fad_offs)/disc->sph;
-		if (disc->old_hunk!=hunk)
-		{
-			chd_read(disc->chd,hunk,disc->hunk_mem); //CHDERR_NONE
-			disc->old_hunk = hunk;
-		}
-
 		u32 hunk_ofs = fad_offs%disc->sph;
 
-		memcpy(dst, disc->hunk_mem + hunk_ofs * (2352+96), fmt);
+		if (!disc->cache->read(hunk, hunk_ofs * (2352+96), dst, fmt))
+			memset(dst, 0, fmt);
 
 		if (swap_bytes)
 		{
@@ -97,8 +96,6 @@ bool CHDDisc::TryOpen(const char* file)
 	const chd_header* head = chd_get_header(chd);
 
 	hunkbytes = head->hunkbytes;
-	hunk_mem = new u8[hunkbytes];
-	old_hunk=0xFFFFFFF;
 
 	sph = hunkbytes/(2352+96);
 
@@ -107,6 +104,15 @@ bool CHDDisc::TryOpen(const char* file)
 		INFO_LOG(GDROM, "chd: hunkbytes is invalid, %d\n",hunkbytes);
 		return false;
 	}
+	cache.reset(new HunkCache([this](u32 hunk, u8 *dst) {
+			chd_error err = chd_read(chd, hunk, dst);
+			if (err != CHDERR_NONE)
+			{
+				WARN_LOG(GDROM, "chd: error %d reading hunk %d", err, hunk);
+				return false;
+			}
+			return true;
+		}, hunkbytes, head->totalhunks, config::ChdCacheSize));
 
 	u32 tag;
 	u8 flags;
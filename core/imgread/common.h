@@ -116,6 +116,15 @@ struct Session
 struct TrackFile
 {
 	virtual void Read(u32 FAD,u8* dst,SectorFormat* sector_type,u8* subcode,SubcodeFormat* subcode_type)=0;
+	// Reads count consecutive sectors. Returns the size of each sector in dst.
+	// The default implementation reads one sector at a time.
+	virtual u32 ReadSectors(u32 FAD, u32 count, u8* dst, SectorFormat* sector_type)
+	{
+		SubcodeFormat subcode_type;
+		for (u32 i = 0; i < count; i++)
+			Read(FAD + i, dst + i * 2448, sector_type, q_subchannel, &subcode_type);
+		return 2448;
+	}
 	virtual ~TrackFile() = default;;
 };
 
@@ -135,9 +144,13 @@ struct Track
 		CTRL = 0;
 		ADDR = 0;
 	}
+	bool Contains(u32 FAD) const
+	{
+		return FAD>=StartFAD && (FAD<=EndFAD || EndFAD==0) && file;
+	}
 	bool Read(u32 FAD,u8* dst,SectorFormat* sector_type,u8* subcode,SubcodeFormat* subcode_type)
 	{
-		if (FAD>=StartFAD && (FAD<=EndFAD || EndFAD==0) && file)
+		if (Contains(FAD))
 		{
 			file->Read(FAD,dst,sector_type,subcode,subcode_type);
 			return true;
@@ -172,19 +185,19 @@ struct Disc
 
 	void ReadSectors(u32 FAD,u32 count,u8* dst,u32 fmt)
 	{
-		u8 temp[2448];
-		SectorFormat secfmt;
-		SubcodeFormat subfmt;
+		// Consecutive sectors are read from each track in batches, then converted
+		constexpr u32 BatchSize = 256;
+		std::vector<u8> temp(std::min(count, BatchSize) * 2448);
 
 		u32 progress = ~0;
-		for (u32 i = 1; i <= count; i++)
+		for (u32 i = 0; i < count; )
 		{
 			if (count >= 1000)
 			{
 				if (loading_canceled)
 					break;
 				// Progress report when loading naomi gd-rom games
-				const u32 new_progress = i * 100 / count;
+				const u32 new_progress = (i + 1) * 100 / count;
 				if (progress != new_progress)
 				{
 					progress = new_progress;
@@ -193,41 +206,28 @@ struct Disc
 					gui_display_notification(status_str, 2000);
 				}
 			}
-			if (ReadSector(FAD,temp,&secfmt,q_subchannel,&subfmt))
+			Track *track = FindTrack(FAD);
+			if (track == nullptr)
 			{
-				//TODO: Proper sector conversions
-				if (secfmt==SECFMT_2352)
-				{
-					ConvertSector(temp,dst,2352,fmt,FAD);
-				}
-				else if (fmt == 2048 && secfmt==SECFMT_2336_MODE2)
-					memcpy(dst,temp+8,2048);
-				else if (fmt==2048 && (secfmt==SECFMT_2048_MODE1 || secfmt==SECFMT_2048_MODE2_FORM1 ))
-				{
-					memcpy(dst,temp,2048);
-				}
-				else if (fmt==2352 && (secfmt==SECFMT_2048_MODE1 || secfmt==SECFMT_2048_MODE2_FORM1 ))
-				{
-					INFO_LOG(GDROM, "GDR:fmt=2352;secfmt=2048");
-					memcpy(dst,temp,2048);
-				}
-				else if (fmt==2048 && secfmt==SECFMT_2448_MODE2)
-				{
-					// Pier Solar and the Great Architects
-					ConvertSector(temp, dst, 2448, fmt, FAD);
-				}
-				else
-				{
-					WARN_LOG(GDROM, "ERROR: UNABLE TO CONVERT SECTOR. THIS IS FATAL. Format: %d Sector format: %d", fmt, secfmt);
-					//verify(false);
-				}
+				INFO_LOG(GDROM, "Sector Read miss FAD: %d", FAD);
+				dst+=fmt;
+				FAD++;
+				i++;
+				continue;
 			}
-			else
+			u32 batch = std::min(count - i, BatchSize);
+			if (track->EndFAD != 0)
+				batch = std::min(batch, track->EndFAD - FAD + 1);
+
+			SectorFormat secfmt;
+			const u32 size = track->file->ReadSectors(FAD, batch, temp.data(), &secfmt);
+			for (u32 j = 0; j < batch; j++)
 			{
-				INFO_LOG(GDROM, "Sector Read miss FAD: %d", FAD);
+				ConvertSector(&temp[j * size], secfmt, dst, fmt, FAD);
+				dst+=fmt;
+				FAD++;
 			}
-			dst+=fmt;
-			FAD++;
+			i += batch;
 		}
 	}
 	virtual ~Disc() 
@@ -278,6 +278,45 @@ struct Disc
 			std::fclose(fo);
 		}
 	}
+
+private:
+	Track *FindTrack(u32 FAD)
+	{
+		for (size_t i=tracks.size();i-->0;)
+			if (tracks[i].Contains(FAD))
+				return &tracks[i];
+		return nullptr;
+	}
+
+	static void ConvertSector(u8 *src, SectorFormat secfmt, u8 *dst, u32 fmt, u32 FAD)
+	{
+		//TODO: Proper sector conversions
+		if (secfmt==SECFMT_2352)
+		{
+			::ConvertSector(src,dst,2352,fmt,FAD);
+		}
+		else if (fmt == 2048 && secfmt==SECFMT_2336_MODE2)
+			memcpy(dst,src+8,2048);
+		else if (fmt==2048 && (secfmt==SECFMT_2048_MODE1 || secfmt==SECFMT_2048_MODE2_FORM1 ))
+		{
+			memcpy(dst,src,2048);
+		}
+		else if (fmt==2352 && (secfmt==SECFMT_2048_MODE1 || secfmt==SECFMT_2048_MODE2_FORM1 ))
+		{
+			INFO_LOG(GDROM, "GDR:fmt=2352;secfmt=2048");
+			memcpy(dst,src,2048);
+		}
+		else if (fmt==2048 && secfmt==SECFMT_2448_MODE2)
+		{
+			// Pier Solar and the Great Architects
+			::ConvertSector(src, dst, 2448, fmt, FAD);
+		}
+		else
+		{
+			WARN_LOG(GDROM, "ERROR: UNABLE TO CONVERT SECTOR. THIS IS FATAL. Format: %d Sector format: %d", fmt, secfmt);
+			//verify(false);
+		}
+	}
 };
 
 extern Disc* disc;
@@ -301,6 +340,11 @@ struct RawTrackFile : TrackFile
 	}
 
 	void Read(u32 FAD,u8* dst,SectorFormat* sector_type,u8* subcode,SubcodeFormat* subcode_type) override
+	{
+		ReadSectors(FAD, 1, dst, sector_type);
+	}
+
+	u32 ReadSectors(u32 FAD, u32 count, u8* dst, SectorFormat* sector_type) override
 	{
 		//for now hackish
 		if (fmt==2352)
@@ -317,7 +361,11 @@ struct RawTrackFile : TrackFile
 		}
 
 		std::fseek(file, offset + FAD * fmt, SEEK_SET);
-		std::fread(dst, 1, fmt, file);
+		size_t read = std::fread(dst, 1, count * fmt, file);
+		if (read < count * fmt)
+			memset(dst + read, 0, count * fmt - read);
+
+		return fmt;
 	}
 	~RawTrackFile() override
 	{
@@ -0,0 +1,230 @@
+/*
+	Copyright 2026 Flycast contributors
+
+	This file is part of Flycast.
+
+    Flycast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    Flycast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Flycast.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include "types.h"
+#include "oslib/oslib.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//
+// LRU cache of decompressed hunks.
+// A background thread decompresses the hunks following the last one read,
+// in the current read direction.
+//
+class HunkCache
+{
+public:
+	struct Stats
+	{
+		u32 hits = 0;
+		u32 misses = 0;
+		u32 readAheadHits = 0;		// hits on a hunk decompressed by the read-ahead thread
+		u32 decompressed = 0;
+		double decompressTime = 0;	// seconds
+	};
+
+	// Decompresses a hunk into dst. Returns false on error.
+	using ReadHunk = std::function<bool(u32 hunk, u8 *dst)>;
+
+	HunkCache(ReadHunk readHunk, u32 hunkbytes, u32 totalhunks, int capacity)
+		: readHunk(readHunk), totalhunks(totalhunks)
+	{
+		entries.resize(std::max(capacity, 1));
+		for (Entry& entry : entries)
+			entry.data.reset(new u8[hunkbytes]);
+		// The current hunk and the one before must never be evicted by the read-ahead
+		readAhead = std::min<int>(ReadAhead, (int)entries.size() - 2);
+		if (readAhead > 0)
+			thread = std::thread(&HunkCache::readAheadLoop, this);
+	}
+
+	~HunkCache()
+	{
+		if (thread.joinable())
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				running = false;
+			}
+			wakeup.notify_one();
+			thread.join();
+		}
+		if (stats.hits + stats.misses > 0)
+			INFO_LOG(GDROM, "chd: %d hunk reads, %.1f%% hits (%d read-ahead), %d hunks decompressed in %.1f ms",
+					stats.hits + stats.misses, stats.hits * 100.0 / (stats.hits + stats.misses),
+					stats.readAheadHits, stats.decompressed, stats.decompressTime * 1000.0);
+	}
+
+	// Copies size bytes at the given offset of a hunk. Returns false on error.
+	bool read(u32 hunk, u32 offset, u8 *dst, u32 size)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		Entry *entry = find(hunk);
+		// Wait for the read-ahead thread if it's decompressing this hunk
+		while (entry != nullptr && entry->loading)
+		{
+			loaded.wait(lock);
+			entry = find(hunk);
+		}
+		if (entry != nullptr)
+		{
+			stats.hits++;
+			if (entry->readAhead)
+			{
+				stats.readAheadHits++;
+				entry->readAhead = false;
+			}
+		}
+		else
+		{
+			stats.misses++;
+			entry = allocate(hunk);
+			lock.unlock();
+			bool success = decompress(entry);
+			lock.lock();
+			entry->loading = false;
+			if (!success)
+			{
+				entry->hunk = InvalidHunk;
+				loaded.notify_all();
+				return false;
+			}
+			loaded.notify_all();
+		}
+		entry->lastUse = ++useCounter;
+		memcpy(dst, entry->data.get() + offset, size);
+
+		if (readAhead > 0 && hunk != lastHunk)
+		{
+			direction = hunk < lastHunk && lastHunk != InvalidHunk ? -1 : 1;
+			lastHunk = hunk;
+			nextHunk = hunk + direction;
+			pendingHunks = readAhead;
+			lock.unlock();
+			wakeup.notify_one();
+		}
+		return true;
+	}
+
+	const Stats& getStats() const {
+		return stats;
+	}
+
+private:
+	static constexpr u32 InvalidHunk = ~0u;
+	static constexpr int ReadAhead = 2;
+
+	struct Entry
+	{
+		u32 hunk = InvalidHunk;
+		u64 lastUse = 0;
+		bool loading = false;
+		bool readAhead = false;
+		std::unique_ptr<u8[]> data;
+	};
+
+	// mutex must be held
+	Entry *find(u32 hunk)
+	{
+		for (Entry& entry : entries)
+			if (entry.hunk == hunk)
+				return &entry;
+		return nullptr;
+	}
+
+	// Evicts the least recently used entry. mutex must be held
+	Entry *allocate(u32 hunk)
+	{
+		Entry *lru = nullptr;
+		for (Entry& entry : entries)
+			if (!entry.loading && (lru == nullptr || entry.lastUse < lru->lastUse))
+				lru = &entry;
+		verify(lru != nullptr);
+		lru->hunk = hunk;
+		lru->loading = true;
+		lru->readAhead = false;
+		lru->lastUse = ++useCounter;
+		return lru;
+	}
+
+	// Called without holding mutex. The entry is protected by its loading flag.
+	bool decompress(Entry *entry)
+	{
+		std::lock_guard<std::mutex> lock(readMutex);
+		double start = os_GetSeconds();
+		bool success = readHunk(entry->hunk, entry->data.get());
+		double time = os_GetSeconds() - start;
+		stats.decompressed++;
+		stats.decompressTime += time;
+		return success;
+	}
+
+	void readAheadLoop()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		for (;;)
+		{
+			wakeup.wait(lock, [this]() { return !running || pendingHunks > 0; });
+			if (!running)
+				break;
+			u32 hunk = nextHunk;
+			nextHunk += direction;
+			pendingHunks--;
+			if (hunk >= totalhunks || find(hunk) != nullptr)
+				continue;
+			Entry *entry = allocate(hunk);
+			entry->readAhead = true;
+			lock.unlock();
+			bool success = decompress(entry);
+			lock.lock();
+			entry->loading = false;
+			if (!success)
+			{
+				entry->hunk = InvalidHunk;
+				entry->readAhead = false;
+				pendingHunks = 0;
+			}
+			loaded.notify_all();
+		}
+	}
+
+	const ReadHunk readHunk;
+	const u32 totalhunks;
+	std::vector<Entry> entries;
+	u64 useCounter = 0;
+	Stats stats;
+	std::mutex mutex;			// protects everything but the hunk data being decompressed
+	std::condition_variable loaded;
+	std::mutex readMutex;		// readHunk isn't reentrant
+
+	int readAhead = 0;
+	std::thread thread;
+	std::condition_variable wakeup;
+	bool running = true;
+	u32 lastHunk = InvalidHunk;
+	int direction = 1;
+	u32 nextHunk = 0;
+	int pendingHunks = 0;
+};
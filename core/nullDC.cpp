@@ -2,6 +2,7 @@
 //
 #include <atomic>
 #include <future>
+#include <mutex>
 #include <thread>
 
 #include "types.h"
@@ -28,6 +29,7 @@
 #include "imgread/common.h"
 #include "rend/gui.h"
 #include "profiler/profiler.h"
+#include "profiler/perf_jit.h"
 #include "input/gamepad_device.h"
 #include "hw/sh4/dyna/blockmanager.h"
 #include "log/LogManager.h"
@@ -38,14 +40,20 @@
 #include "rend/mainui.h"
 #include "archive/rzip.h"
 #include "debug/gdb_server.h"
+#include "rewind.h"
 
 settings_t settings;
 
 cThread emu_thread(&dc_run, NULL);
 
 static std::future<void> loading_done;
+static void wait_savestate_writer();
 std::atomic<bool> loading_canceled;
 static bool init_done;
+// Set while another thread is stopping the emulator
+static bool stop_requested;
+// Makes the emulator thread decision to (re)start the cpu atomic with dc_stop()
+static std::mutex run_mutex;
 
 static s32 plugins_Init()
 {
@@ -466,6 +474,7 @@ void dc_init()
 	plugins_Init();
 	mem_Init();
 	reios_init();
+	rewinder::init();
 
 	// the recompiler may start generating code at this point and needs a fully configured machine
 #if FEAT_SHREC != DYNAREC_NONE
@@ -620,18 +629,39 @@ void* dc_run(void*)
 	}
 	else
 	{
-		do {
-			reset_requested = false;
+		reset_requested = false;
+		for (;;)
+		{
+			bool stopped;
+			{
+				std::lock_guard<std::mutex> lock(run_mutex);
+				stopped = stop_requested;
+				if (!stopped)
+					sh4_cpu.Start();
+			}
+			if (!stopped)
+			{
+				sh4_cpu.Run();
 
-			sh4_cpu.Run();
+				if (rewinder::capturePending())
+				{
+					// The cpu was only stopped to take a rewind snapshot
+					rewinder::capture();
+					if (!reset_requested)
+						continue;
+				}
+			}
 
 			SaveRomFiles();
 
-			if (reset_requested)
-				dc_reset(false);
-		} while (reset_requested);
+			if (!reset_requested)
+				break;
+			reset_requested = false;
+			dc_reset(false);
+		}
 	}
 
+    libAICA_Sync();
     TermAudio();
 
     return NULL;
@@ -655,7 +685,9 @@ void dc_term_game()
 void dc_term()
 {
 	dc_term_game();
+	wait_savestate_writer();
 	debugger::term();
+	rewinder::term();
 	dc_cancel_load();
 	sh4_cpu.Term();
 	if (settings.platform.system != DC_PLATFORM_DREAMCAST)
@@ -663,6 +695,7 @@ void dc_term()
 	plugins_Term();
 	mem_Term();
 	_vmem_release();
+	perfjit::term();
 
 	mcfg_DestroyDevices();
 
@@ -672,9 +705,14 @@ void dc_term()
 void dc_stop()
 {
 	bool running = dc_is_running();
-	sh4_cpu.Stop();
+	{
+		std::lock_guard<std::mutex> lock(run_mutex);
+		stop_requested = true;
+		sh4_cpu.Stop();
+	}
 	rend_cancel_emu_wait();
 	emu_thread.WaitToEnd();
+	stop_requested = false;
 	if (running)
 		EventManager::event(Event::Pause);
 }
@@ -737,7 +775,7 @@ void SaveSettings()
 void dc_resume()
 {
 	SetMemoryHandlers();
-	settings.aica.NoBatch = config::ForceWindowsCE || config::DSPEnabled;
+	settings.aica.NoBatch = config::ForceWindowsCE;
 	int hres;
 	int vres = config::RenderResolution;
 	if (config::Widescreen && !config::Rotate90)
@@ -796,75 +834,105 @@ static std::string get_savestate_file_path(bool writable)
 		return get_readonly_data_path(state_file);
 }
 
+// Savestates are serialized into a persistent buffer on the calling thread.
+// Compression and file I/O are done in the background.
+static std::vector<u8> savestate_data;
+static std::future<void> savestate_done;
+
+static void wait_savestate_writer()
+{
+	if (savestate_done.valid())
+		savestate_done.get();
+}
+
+static void write_savestate(const std::string& filename, u32 total_size)
+{
+	RZipFile zipFile;
+	if (!zipFile.Open(filename, true))
+	{
+		WARN_LOG(SAVESTATE, "Failed to save state - could not open %s for writing", filename.c_str());
+		gui_display_notification("Cannot open save file", 2000);
+		return;
+	}
+	if (zipFile.Write(savestate_data.data(), total_size) != total_size)
+	{
+		WARN_LOG(SAVESTATE, "Failed to save state - error writing %s", filename.c_str());
+		gui_display_notification("Error saving state", 2000);
+		zipFile.Close();
+		return;
+	}
+	zipFile.Close();
+
+	INFO_LOG(SAVESTATE, "Saved state to %s size %d", filename.c_str(), total_size) ;
+	gui_display_notification("State saved", 1000);
+}
+
 void dc_savestate()
 {
 	unsigned int total_size = 0 ;
 	void *data = NULL ;
 
+	// The buffer is still in use until the previous state is written
+	wait_savestate_writer();
+
 	if ( ! dc_serialize(&data, &total_size) )
 	{
 		WARN_LOG(SAVESTATE, "Failed to save state - could not initialize total size") ;
 		gui_display_notification("Save state failed", 2000);
-		cleanup_serialize(data) ;
     	return;
 	}
 
-	data = malloc(total_size) ;
-	if ( data == NULL )
-	{
+	try {
+		savestate_data.resize(total_size);
+	} catch (const std::bad_alloc&) {
 		WARN_LOG(SAVESTATE, "Failed to save state - could not malloc %d bytes", total_size) ;
 		gui_display_notification("Save state failed - memory full", 2000);
-		cleanup_serialize(data) ;
     	return;
 	}
 
-	void *data_ptr = data;
+	void *data_ptr = savestate_data.data();
 
 	if ( ! dc_serialize(&data_ptr, &total_size) )
 	{
 		WARN_LOG(SAVESTATE, "Failed to save state - could not serialize data") ;
 		gui_display_notification("Save state failed", 2000);
-		cleanup_serialize(data) ;
     	return;
 	}
 
 	std::string filename = get_savestate_file_path(true);
-#if 0
-	FILE *f = nowide::fopen(filename.c_str(), "wb") ;
+	savestate_done = std::async(std::launch::async, write_savestate, filename, total_size);
+}
 
-	if ( f == NULL )
-	{
-		WARN_LOG(SAVESTATE, "Failed to save state - could not open %s for writing", filename.c_str()) ;
-		gui_display_notification("Cannot open save file", 2000);
-		cleanup_serialize(data) ;
-    	return;
-	}
+static bool unserialize_state(void *data, u32 total_size)
+{
+	void *data_ptr = data;
 
-	std::fwrite(data, 1, total_size, f) ;
-	std::fclose(f);
-#else
-	RZipFile zipFile;
-	if (!zipFile.Open(filename, true))
-	{
-		WARN_LOG(SAVESTATE, "Failed to save state - could not open %s for writing", filename.c_str());
-		gui_display_notification("Cannot open save file", 2000);
-		cleanup_serialize(data);
-    	return;
-	}
-	if (zipFile.Write(data, total_size) != total_size)
+#if FEAT_AREC == DYNAREC_JIT
+	aicaarm::recompiler::flush();
+#endif
+#ifndef NO_MMU
+    mmu_flush_table();
+#endif
+#if FEAT_SHREC != DYNAREC_NONE
+	bm_Reset();
+#endif
+
+	u32 unserialized_size = 0;
+	if ( ! dc_unserialize(&data_ptr, &unserialized_size) )
 	{
-		WARN_LOG(SAVESTATE, "Failed to save state - error writing %s", filename.c_str());
-		gui_display_notification("Error saving state", 2000);
-		zipFile.Close();
-		cleanup_serialize(data);
-    	return;
+		WARN_LOG(SAVESTATE, "Failed to load state - could not unserialize data") ;
+		gui_display_notification("Invalid save state", 2000);
+    	return false;
 	}
-	zipFile.Close();
-#endif
+	if (unserialized_size != total_size)
+		WARN_LOG(SAVESTATE, "Save state error: read %d bytes but used %d", total_size, unserialized_size);
 
-	cleanup_serialize(data) ;
-	INFO_LOG(SAVESTATE, "Saved state to %s size %d", filename.c_str(), total_size) ;
-	gui_display_notification("State saved", 1000);
+	mmu_set_state();
+	sh4_cpu.ResetCache();
+    dsp.dyndirty = true;
+    sh4_sched_ffts();
+
+    return true;
 }
 
 void dc_loadstate()
@@ -873,6 +941,7 @@ void dc_loadstate()
 	FILE *f = nullptr;
 
 	dc_stop();
+	wait_savestate_writer();
 
 	std::string filename = get_savestate_file_path(false);
 	RZipFile zipFile;
@@ -925,40 +994,35 @@ void dc_loadstate()
 		return;
 	}
 
-	void *data_ptr = data;
-
 	custom_texture.Terminate();
-#if FEAT_AREC == DYNAREC_JIT
-	aicaarm::recompiler::flush();
-#endif
-#ifndef NO_MMU
-    mmu_flush_table();
-#endif
-#if FEAT_SHREC != DYNAREC_NONE
-	bm_Reset();
-#endif
 
-	u32 unserialized_size = 0;
-	if ( ! dc_unserialize(&data_ptr, &unserialized_size) )
+	if (!unserialize_state(data, total_size))
 	{
-		WARN_LOG(SAVESTATE, "Failed to load state - could not unserialize data") ;
-		gui_display_notification("Invalid save state", 2000);
 		cleanup_serialize(data) ;
     	return;
 	}
-	if (unserialized_size != total_size)
-		WARN_LOG(SAVESTATE, "Save state error: read %d bytes but used %d", total_size, unserialized_size);
-
-	mmu_set_state();
-	sh4_cpu.ResetCache();
-    dsp.dyndirty = true;
-    sh4_sched_ffts();
 
     cleanup_serialize(data) ;
 	EventManager::event(Event::LoadState);
     INFO_LOG(SAVESTATE, "Loaded state from %s size %d", filename.c_str(), total_size) ;
 }
 
+void dc_rewind()
+{
+	static std::vector<u8> state;
+
+	dc_stop();
+	if (!rewinder::pop(state))
+	{
+		gui_display_notification("Nothing to rewind", 2000);
+		return;
+	}
+	// The snapshot comes from the current game session, so custom textures are kept
+	// and Event::LoadState isn't raised (it would clear the rewind buffer).
+	if (!unserialize_state(state.data(), state.size()))
+		rewinder::reset();
+}
+
 void dc_load_game(const char *path)
 {
 	loading_canceled = false;
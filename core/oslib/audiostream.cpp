@@ -1,11 +1,34 @@
 #include "audiostream.h"
+#include "spsc_ring.h"
+#include "stdclass.h"
+#include <atomic>
 #include <memory>
+#include <thread>
 
 struct SoundFrame { s16 l; s16 r; };
 
 static SoundFrame Buffer[SAMPLE_COUNT];
 static u32 writePtr;  // next sample index
 
+// Dynamic rate control: the emulator thread resamples its output into a ring buffer and never waits for the
+// audio driver unless the ring is full. An output thread feeds the backend from the ring. The resampling ratio
+// is adjusted slightly so that the ring stays half full, absorbing the drift between the emulation and audio clocks.
+constexpr u32 RingCapacity = SAMPLE_COUNT * 4;
+constexpr float MaxRateDelta = 0.005f;
+
+static bool rateControl;
+static SpscRing<SoundFrame> ring;
+static std::atomic<bool> outputRunning;
+static std::thread outputThread;
+static cResetEvent dataAvailable;
+static cResetEvent spaceAvailable;
+static SoundFrame prevFrame;
+static float resamplePos;
+static float resampleStep = 1.f;
+static std::atomic<float> rateRatio { 1.f };
+static std::atomic<u64> underruns;
+static std::atomic<u64> overruns;
+
 static audiobackend_t *audiobackend_current = nullptr;
 static std::unique_ptr<std::vector<audiobackend_t *>> audiobackends;	// Using a pointer to avoid out of order init
 
@@ -77,8 +100,104 @@ audiobackend_t* GetAudioBackend(const std::string& slug)
 	return nullptr;
 }
 
+static void outputThreadLoop()
+{
+	SoundFrame chunk[SAMPLE_COUNT];
+	bool started = false;
+	while (outputRunning)
+	{
+		if (ring.size() < SAMPLE_COUNT)
+		{
+			// Only count the first wait of each shortage
+			if (started)
+				underruns++;
+			started = false;
+			dataAvailable.Wait(100);
+			continue;
+		}
+		started = true;
+		ring.read(chunk, SAMPLE_COUNT);
+		spaceAvailable.Set();
+		audiobackend_current->push(chunk, SAMPLE_COUNT, true);
+	}
+}
+
+static void startOutputThread()
+{
+	ring.init(RingCapacity);
+	writePtr = 0;
+	resamplePos = 0.f;
+	resampleStep = 1.f;
+	rateRatio = 1.f;
+	underruns = 0;
+	overruns = 0;
+	prevFrame = {};
+	outputRunning = true;
+	outputThread = std::thread(outputThreadLoop);
+}
+
+static void stopOutputThread()
+{
+	if (!outputRunning)
+		return;
+	outputRunning = false;
+	dataAvailable.Set();
+	spaceAvailable.Set();
+	outputThread.join();
+}
+
+// Stops the thread if the process exits without calling TermAudio()
+static struct OutputThreadGuard {
+	~OutputThreadGuard() {
+		stopOutputThread();
+	}
+} outputThreadGuard;
+
+static void pushChunk()
+{
+	u32 written = ring.write(Buffer, SAMPLE_COUNT);
+	while (written < SAMPLE_COUNT && config::LimitFPS && outputRunning)
+	{
+		dataAvailable.Set();
+		spaceAvailable.Wait(100);
+		written += ring.write(Buffer + written, SAMPLE_COUNT - written);
+	}
+	if (written < SAMPLE_COUNT)
+		overruns++;
+	dataAvailable.Set();
+
+	// Produce more frames when the ring is less than half full and fewer when it's more than half full
+	float error = 1.f - 2.f * ring.size() / ring.capacity();
+	float ratio = 1.f + MaxRateDelta * std::min(std::max(error, -1.f), 1.f);
+	rateRatio = ratio;
+	resampleStep = 1.f / ratio;
+}
+
+// Linear interpolation between the previous and current input frames
+static void resampleFrame(SoundFrame frame)
+{
+	while (resamplePos < 1.f)
+	{
+		Buffer[writePtr].l = (s16)(prevFrame.l + (frame.l - prevFrame.l) * resamplePos);
+		Buffer[writePtr].r = (s16)(prevFrame.r + (frame.r - prevFrame.r) * resamplePos);
+		if (++writePtr == SAMPLE_COUNT)
+		{
+			pushChunk();
+			writePtr = 0;
+		}
+		resamplePos += resampleStep;
+	}
+	resamplePos -= 1.f;
+	prevFrame = frame;
+}
+
 void WriteSample(s16 r, s16 l)
 {
+	if (rateControl)
+	{
+		resampleFrame({ l, r });
+		return;
+	}
 	Buffer[writePtr].r = r;
 	Buffer[writePtr].l = l;
 
@@ -90,6 +209,18 @@ void WriteSample(s16 r, s16 l)
 	}
 }
 
+AudioStats GetAudioStats()
+{
+	AudioStats stats;
+	stats.capacity = rateControl ? ring.capacity() : 0;
+	stats.fill = rateControl ? ring.size() : 0;
+	stats.ratio = rateRatio;
+	stats.underruns = underruns;
+	stats.overruns = overruns;
+
+	return stats;
+}
+
 void InitAudio()
 {
 	if (cfgLoadInt("audio", "disable", 0)) {
@@ -112,6 +243,9 @@ void InitAudio()
 
 	INFO_LOG(AUDIO, "Initializing audio backend \"%s\" (%s)...", audiobackend_current->slug.c_str(), audiobackend_current->name.c_str());
 	audiobackend_current->init();
+	rateControl = config::DynamicRateControl;
+	if (rateControl)
+		startOutputThread();
 	if (audio_recording_started)
 	{
 		// Restart recording
@@ -127,6 +261,8 @@ void TermAudio()
 		bool rec_started = audio_recording_started;
 		StopAudioRecording();
 		audio_recording_started = rec_started;
+		stopOutputThread();
+		rateControl = false;
 		audiobackend_current->term();
 		INFO_LOG(AUDIO, "Terminating audio backend \"%s\" (%s)...", audiobackend_current->slug.c_str(), audiobackend_current->name.c_str());
 		audiobackend_current = nullptr;
@@ -52,4 +52,15 @@ u32 GetAudioBackendCount();
 audiobackend_t* GetAudioBackend(int num);
 audiobackend_t* GetAudioBackend(const std::string& slug);
 
+// Dynamic rate control statistics
+struct AudioStats
+{
+	u32 capacity;	// ring buffer size in frames
+	u32 fill;		// frames currently buffered
+	float ratio;	// current output/input rate ratio
+	u64 underruns;	// times the output thread found less than SAMPLE_COUNT frames
+	u64 overruns;	// chunks partially dropped because the ring buffer was full
+};
+AudioStats GetAudioStats();
+
 constexpr u32 SAMPLE_COUNT = 512;	// push() is always called with that many frames
@@ -0,0 +1,89 @@
+/*
+	Copyright 2026 Flycast contributors
+
+	This file is part of Flycast.
+
+    Flycast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    Flycast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Flycast.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include "types.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+//
+// Lock-free single producer, single consumer ring buffer.
+// The indexes are free-running and wrap around modulo 2^32. Capacity is rounded up to a power of two.
+// write() must only be called by the producer thread and read() by the consumer thread.
+//
+template<typename T>
+class SpscRing
+{
+public:
+	void init(u32 capacity)
+	{
+		u32 size = 1;
+		while (size < capacity)
+			size <<= 1;
+		buffer.reset(new T[size]());
+		mask = size - 1;
+		readIndex = 0;
+		writeIndex = 0;
+	}
+
+	u32 capacity() const {
+		return mask + 1;
+	}
+
+	// Number of elements available to the consumer. May be stale by the time it's used.
+	u32 size() const {
+		return writeIndex.load(std::memory_order_acquire) - readIndex.load(std::memory_order_acquire);
+	}
+
+	// Returns the number of elements written, which may be less than count if the ring is full
+	u32 write(const T *data, u32 count)
+	{
+		const u32 wi = writeIndex.load(std::memory_order_relaxed);
+		const u32 ri = readIndex.load(std::memory_order_acquire);
+		count = std::min(count, capacity() - (wi - ri));
+		const u32 start = wi & mask;
+		const u32 first = std::min(count, capacity() - start);
+		std::copy(data, data + first, buffer.get() + start);
+		std::copy(data + first, data + count, buffer.get());
+		writeIndex.store(wi + count, std::memory_order_release);
+
+		return count;
+	}
+
+	// Returns the number of elements read, which may be less than count if the ring doesn't hold enough
+	u32 read(T *data, u32 count)
+	{
+		const u32 ri = readIndex.load(std::memory_order_relaxed);
+		const u32 wi = writeIndex.load(std::memory_order_acquire);
+		count = std::min(count, wi - ri);
+		const u32 start = ri & mask;
+		const u32 first = std::min(count, capacity() - start);
+		std::copy(buffer.get() + start, buffer.get() + start + first, data);
+		std::copy(buffer.get(), buffer.get() + count - first, data + first);
+		readIndex.store(ri + count, std::memory_order_release);
+
+		return count;
+	}
+
+private:
+	std::unique_ptr<T[]> buffer;
+	u32 mask = 0;
+	alignas(64) std::atomic<u32> readIndex { 0 };
+	alignas(64) std::atomic<u32> writeIndex { 0 };
+};
@@ -0,0 +1,235 @@
+/*
+	Copyright 2026 Flycast contributors
+
+	This file is part of Flycast.
+
+    Flycast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    Flycast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Flycast.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "perf_jit.h"
+#include "cfg/option.h"
+
+#include <xxhash.h>
+
+#if defined(__linux__) && !defined(__ANDROID__)
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cinttypes>
+#include <ctime>
+#include <mutex>
+#define PERF_JIT
+#endif
+
+namespace perfjit
+{
+
+#ifdef PERF_JIT
+
+// See tools/perf/Documentation/jitdump-specification.txt in the linux kernel tree
+struct JitHeader
+{
+	u32 magic;
+	u32 version;
+	u32 total_size;
+	u32 elf_mach;
+	u32 pad1;
+	u32 pid;
+	u64 timestamp;
+	u64 flags;
+};
+
+struct JitRecordHeader
+{
+	u32 id;
+	u32 total_size;
+	u64 timestamp;
+};
+
+struct JitCodeLoad
+{
+	JitRecordHeader header;
+	u32 pid;
+	u32 tid;
+	u64 vma;
+	u64 code_addr;
+	u64 code_size;
+	u64 code_index;
+	// followed by the null-terminated name and the code
+};
+
+enum { JIT_CODE_LOAD = 0, JIT_CODE_CLOSE = 3 };
+
+#if HOST_CPU == CPU_X64
+constexpr u32 ElfMachine = EM_X86_64;
+#elif HOST_CPU == CPU_ARM64
+constexpr u32 ElfMachine = EM_AARCH64;
+#elif HOST_CPU == CPU_ARM
+constexpr u32 ElfMachine = EM_ARM;
+#elif HOST_CPU == CPU_X86
+constexpr u32 ElfMachine = EM_386;
+#else
+constexpr u32 ElfMachine = EM_NONE;
+#endif
+
+static std::mutex mutex;
+static FILE *mapFile;
+static FILE *dumpFile;
+// perf finds the jitdump file through this executable mapping
+static void *dumpMarker;
+static size_t markerSize;
+static u64 codeIndex;
+static bool openFailed;
+
+static u64 timestamp()
+{
+	// perf record -k mono
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static bool open()
+{
+	if (mapFile != nullptr)
+		return true;
+	if (openFailed)
+		return false;
+	char path[64];
+	sprintf(path, "/tmp/perf-%d.map", (int)getpid());
+	mapFile = fopen(path, "w");
+	if (mapFile == nullptr)
+	{
+		WARN_LOG(DYNAREC, "Can't create %s", path);
+		openFailed = true;
+		return false;
+	}
+	sprintf(path, "/tmp/jit-%d.dump", (int)getpid());
+	int fd = ::open(path, O_CREAT | O_TRUNC | O_RDWR, 0666);
+	if (fd != -1)
+	{
+		markerSize = sysconf(_SC_PAGESIZE);
+		dumpMarker = mmap(nullptr, markerSize, PROT_READ | PROT_EXEC, MAP_PRIVATE, fd, 0);
+		if (dumpMarker == MAP_FAILED)
+		{
+			dumpMarker = nullptr;
+			::close(fd);
+		}
+		else
+		{
+			dumpFile = fdopen(fd, "wb");
+		}
+	}
+	if (dumpFile == nullptr)
+	{
+		WARN_LOG(DYNAREC, "Can't create %s", path);
+	}
+	else
+	{
+		JitHeader header{};
+		header.magic = 0x4A695444;
+		header.version = 1;
+		header.total_size = sizeof(header);
+		header.elf_mach = ElfMachine;
+		header.pid = getpid();
+		header.timestamp = timestamp();
+		fwrite(&header, sizeof(header), 1, dumpFile);
+		fflush(dumpFile);
+	}
+	INFO_LOG(DYNAREC, "perf map enabled");
+
+	return true;
+}
+
+bool enabled()
+{
+	return config::DynarecPerfMap;
+}
+
+void codeLoaded(const void *code, u32 size, const char *name)
+{
+	if (!enabled() || size == 0)
+		return;
+	std::lock_guard<std::mutex> _(mutex);
+	if (!open())
+		return;
+	fprintf(mapFile, "%" PRIxPTR " %x %s\n", (uintptr_t)code, size, name);
+	// the process may not exit cleanly
+	fflush(mapFile);
+
+	if (dumpFile == nullptr)
+		return;
+	u32 nameSize = strlen(name) + 1;
+	JitCodeLoad record;
+	record.header.id = JIT_CODE_LOAD;
+	record.header.total_size = sizeof(record) + nameSize + size;
+	record.header.timestamp = timestamp();
+	record.pid = getpid();
+	record.tid = syscall(SYS_gettid);
+	record.vma = (uintptr_t)code;
+	record.code_addr = (uintptr_t)code;
+	record.code_size = size;
+	record.code_index = codeIndex++;
+	fwrite(&record, sizeof(record), 1, dumpFile);
+	fwrite(name, nameSize, 1, dumpFile);
+	fwrite(code, size, 1, dumpFile);
+	fflush(dumpFile);
+}
+
+void term()
+{
+	std::lock_guard<std::mutex> _(mutex);
+	if (mapFile != nullptr)
+	{
+		fclose(mapFile);
+		mapFile = nullptr;
+	}
+	if (dumpFile != nullptr)
+	{
+		JitRecordHeader record;
+		record.id = JIT_CODE_CLOSE;
+		record.total_size = sizeof(record);
+		record.timestamp = timestamp();
+		fwrite(&record, sizeof(record), 1, dumpFile);
+		fclose(dumpFile);
+		dumpFile = nullptr;
+	}
+	if (dumpMarker != nullptr)
+	{
+		munmap(dumpMarker, markerSize);
+		dumpMarker = nullptr;
+	}
+	codeIndex = 0;
+	openFailed = false;
+}
+
+#else
+
+bool enabled() {
+	return false;
+}
+void codeLoaded(const void *code, u32 size, const char *name) {
+}
+void term() {
+}
+
+#endif
+
+u32 guestHash(const void *data, u32 size)
+{
+	return XXH32(data, size, 7);
+}
+
+}
@@ -0,0 +1,35 @@
+/*
+	Copyright 2026 Flycast contributors
+
+	This file is part of Flycast.
+
+    Flycast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    Flycast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Flycast.  If not, see <https://www.gnu.org/licenses/>.
+*/
+// Linux perf support for the generated code.
+// When enabled, each code block is described in /tmp/perf-<pid>.map for perf report
+// and in a jitdump file (/tmp/jit-<pid>.dump) for perf inject --jit.
+#pragma once
+#include "types.h"
+
+namespace perfjit
+{
+
+bool enabled();
+// name should identify the guest code, e.g. "sh4:8C010000,c:12,h:1A2B3C4D"
+void codeLoaded(const void *code, u32 size, const char *name);
+// Hash of the guest code used to annotate the blocks
+u32 guestHash(const void *data, u32 size);
+void term();
+
+}
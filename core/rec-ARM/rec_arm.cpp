@@ -169,6 +169,7 @@ static u32 blockno=0;
 extern "C" void no_update();
 extern "C" void intc_sched();
 extern "C" void ngen_blockcheckfail();
+extern "C" void ngen_blockhot();
 
 
 extern "C" void ngen_LinkBlock_Generic_stub();
@@ -2046,13 +2047,6 @@ void ngen_Compile(RuntimeBlockInfo* block, bool force_checks, bool reset, bool s
 
 	u8* blk_start=(u8*)EMIT_GET_PTR();
 
-	if (staging)
-	{
-		MOV32(r0,(u32)&block->staging_runs);
-		LDR(r1,r0);
-		SUB(r1,r1,1);
-		STR(r1,r0);
-	}
 	//pre-load the first reg alloc operations, for better efficiency ..
 	if (!block->oplist.empty())
 		reg.OpBegin(&block->oplist[0],0);
@@ -2099,6 +2093,17 @@ void ngen_Compile(RuntimeBlockInfo* block, bool force_checks, bool reset, bool s
 		}
 	}
 
+	// After the block checks: the block must be up to date when it gets optimized
+	if (staging)
+	{
+		MOV32(r0,(u32)&block->staging_runs);
+		LDR(r1,r0);
+		SUB(r1,r1,1,true,CC_AL);
+		STR(r1,r0);
+		MOV32(r0,block->addr);
+		JUMP((u32)ngen_blockhot, CC_EQ);
+	}
+
 	u32 cyc=block->guest_cycles;
 	if (!is_i8r4(cyc))
 	{
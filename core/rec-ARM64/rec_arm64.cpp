@@ -65,6 +65,7 @@ struct DynaCode;
 static DynaCode *arm64_intc_sched;
 static DynaCode *arm64_no_update;
 static DynaCode *blockCheckFail;
+static DynaCode *blockHot;
 static DynaCode *linkBlockGenericStub;
 static DynaCode *linkBlockBranchStub;
 static DynaCode *linkBlockNextStub;
@@ -96,12 +97,12 @@ void ngen_ResetBlocks()
 
 	if (p_sh4rcb->cntx.CpuRunning)
 	{
-		// Force the dynarec out of mainloop() to regenerate it
+		// Force the dynarec out of mainloop() to enter the new one
 		p_sh4rcb->cntx.CpuRunning = 0;
 		restarting = true;
 	}
-	else
-		generate_mainloop();
+	// Before any block so that it isn't in an evictable region of the code cache
+	generate_mainloop();
 }
 
 void ngen_GetFeatures(ngen_features* dst)
@@ -311,6 +312,18 @@ public:
 		//printf("REC-ARM64 compiling %08x\n", block->addr);
 		this->block = block;
 		CheckBlock(force_checks, block);
+		if (staging)
+		{
+			Label cold;
+			Mov(x9, reinterpret_cast<uintptr_t>(&block->staging_runs));
+			Ldr(w10, MemOperand(x9));
+			Subs(w10, w10, 1);
+			Str(w10, MemOperand(x9));
+			B(ne, &cold);
+			Mov(w0, block->addr);
+			GenBranch(blockHot);
+			Bind(&cold);
+		}
 		
 		// run register allocator
 		regalloc.DoAlloc(block);
@@ -338,9 +351,13 @@ public:
 		Bind(&cpu_running);
 		Bind(&cycles_remaining);
 
+		// xmtrx is kept in v16-v19 across consecutive ftrv ops
+		bool xmtrxLoaded = false;
 		for (size_t i = 0; i < block->oplist.size(); i++)
 		{
 			shil_opcode& op  = block->oplist[i];
+			if (op.op != shop_ftrv)
+				xmtrxLoaded = false;
 			regalloc.OpBegin(&op, i);
 
 			switch (op.op)
@@ -946,15 +963,16 @@ public:
 			case shop_ftrv:
 				Add(x9, x28, sh4_context_mem_operand(op.rs1.reg_ptr()).GetOffset());
 				Ld1(v0.V4S(), MemOperand(x9));
-				Add(x9, x28, sh4_context_mem_operand(op.rs2.reg_ptr()).GetOffset());
-				Ld1(v1.V4S(), MemOperand(x9, 16, PostIndex));
-				Ld1(v2.V4S(), MemOperand(x9, 16, PostIndex));
-				Ld1(v3.V4S(), MemOperand(x9, 16, PostIndex));
-				Ld1(v4.V4S(), MemOperand(x9, 16, PostIndex));
-				Fmul(v5.V4S(), v1.V4S(), s0, 0);
-				Fmla(v5.V4S(), v2.V4S(), s0, 1);
-				Fmla(v5.V4S(), v3.V4S(), s0, 2);
-				Fmla(v5.V4S(), v4.V4S(), s0, 3);
+				if (!xmtrxLoaded)
+				{
+					Add(x9, x28, sh4_context_mem_operand(op.rs2.reg_ptr()).GetOffset());
+					Ld1(v16.V4S(), v17.V4S(), v18.V4S(), v19.V4S(), MemOperand(x9));
+					xmtrxLoaded = true;
+				}
+				Fmul(v5.V4S(), v16.V4S(), s0, 0);
+				Fmla(v5.V4S(), v17.V4S(), s0, 1);
+				Fmla(v5.V4S(), v18.V4S(), s0, 2);
+				Fmla(v5.V4S(), v19.V4S(), s0, 3);
 				Add(x9, x28, sh4_context_mem_operand(op.rd.reg_ptr()).GetOffset());
 				St1(v5.V4S(), MemOperand(x9));
 				break;
@@ -1475,8 +1493,16 @@ public:
 		}
 
 		// Block check fail
+		Label recompiledLabel;
 		blockCheckFail = GetCursorAddress<DynaCode *>();
 		GenCallRuntime(rdv_BlockCheckFail);
+		B(&recompiledLabel);
+
+		// Staging block is hot
+		blockHot = GetCursorAddress<DynaCode *>();
+		GenCallRuntime(rdv_BlockHot);
+
+		Bind(&recompiledLabel);
 		if (mmu_enabled())
 		{
 			Label jumpblockLabel;
@@ -2296,7 +2322,6 @@ static void generate_mainloop()
 
 RuntimeBlockInfo* ngen_AllocateBlock()
 {
-	generate_mainloop();
 	return new DynaRBI();
 }
 
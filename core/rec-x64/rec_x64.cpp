@@ -21,13 +21,12 @@ using namespace Xbyak::util;
 #include "hw/mem/vmem32.h"
 #include "oslib/oslib.h"
 #include "x64_regalloc.h"
+#include "profiler/profiler.h"
 #include "xbyak_base.h"
 
 struct DynaRBI : RuntimeBlockInfo
 {
-	u32 Relink() override {
-		return 0;
-	}
+	u32 Relink() override;
 
 	void Relocate(void* dst) override {
 		verify(false);
@@ -43,6 +42,19 @@ u32 mem_rewrites_w, mem_rewrites_r;
 
 static u32 exception_raised;
 static u64 jmp_rsp;
+static const void *linkBlockBranchStub;
+static const void *linkBlockNextStub;
+
+// Blocks jump directly to their successors instead of returning to the main loop.
+// The jump targets are relative so this requires RWX pages.
+static bool blockLinkingEnabled()
+{
+#if defined(NO_BLOCK_LINKING) || defined(FEAT_NO_RWX_PAGES)
+	return false;
+#else
+	return !mmu_enabled();
+#endif
+}
 
 namespace MemSize {
 	enum {
@@ -84,8 +96,15 @@ void ngen_mainloop(void *)
 	}
 }
 
+// Called by the main loop and the blocks when the next block isn't compiled
+static void failedToFindBlock()
+{
+	cycle_counter -= rdv_CompileOrInterpret();
+}
+
 void ngen_init()
 {
+	ngen_FailedToFindBlock = &failedToFindBlock;
 }
 
 void ngen_GetFeatures(ngen_features* dst)
@@ -104,6 +123,10 @@ static void ngen_blockcheckfail(u32 pc) {
 	rdv_BlockCheckFail(pc);
 }
 
+static void ngen_blockhot(u32 pc) {
+	rdv_BlockHot(pc);
+}
+
 static void handle_mem_exception(u32 exception_raised, u32 pc)
 {
 	if (exception_raised)
@@ -191,6 +214,7 @@ public:
 
 	BlockCompiler() : BaseCompiler(), regalloc(this) { }
 	BlockCompiler(u8 *code_ptr) : BaseCompiler(code_ptr), regalloc(this) { }
+	BlockCompiler(u8 *code_ptr, size_t size) : BaseCompiler(code_ptr, size), regalloc(this) { }
 
 	void compile(RuntimeBlockInfo* block, bool force_checks, bool reset, bool staging, bool optimise)
 	{
@@ -198,6 +222,13 @@ public:
 		current_opid = -1;
 
 		CheckBlock(force_checks, block);
+		if (staging)
+		{
+			mov(call_regs[0], block->addr);
+			mov(rax, (uintptr_t)&block->staging_runs);
+			sub(dword[rax], 1);
+			jz(reinterpret_cast<const void*>(CC_RX2RW(&ngen_blockhot)));
+		}
 
 #ifdef _WIN32
 		sub(rsp, 0x28);		// 32-byte shadow space + 8 byte alignment
@@ -226,11 +257,14 @@ public:
 		sub(dword[rip + &cycle_counter], block->guest_cycles);
 #endif
 		regalloc.DoAlloc(block);
+		xmtrxLoaded = false;
 
 		for (current_opid = 0; current_opid < block->oplist.size(); current_opid++)
 		{
 			shil_opcode& op  = block->oplist[current_opid];
 
+			if (op.op != shop_ftrv)
+				releaseXmtrx();
 			regalloc.OpBegin(&op, current_opid);
 
 			switch (op.op)
@@ -447,6 +481,14 @@ public:
 				}
 				break;
 
+			case shop_fipr:
+				genFipr(op);
+				break;
+
+			case shop_ftrv:
+				genFtrv(op);
+				break;
+
 			case shop_frswap:
 				mov(rax, (uintptr_t)op.rs1.reg_ptr());
 				mov(rcx, (uintptr_t)op.rd.reg_ptr());
@@ -491,18 +533,47 @@ public:
 			}
 			regalloc.OpEnd(&op);
 		}
+		releaseXmtrx();
 		regalloc.Cleanup();
 		current_opid = -1;
 
-		mov(rax, (size_t)&next_pc);
+		if (blockLinkingEnabled())
+		{
+			block->relink_offset = (u32)getSize();
+			block->relink_data = 0;
+		}
+		genBlockEnd(block, blockLinkingEnabled());
+
+		ready();
+
+		block->code = (DynarecCodeEntryPtr)getCode();
+		block->host_code_size = getSize();
+
+		emit_Skip(getSize());
+	}
 
+	// Sets next_pc and leaves the block.
+	// Linked blocks jump directly to their successors. Their block end is re-emitted when the block
+	// is linked or unlinked, so the generated code must have the same size regardless of the linking state.
+	void genBlockEnd(RuntimeBlockInfo* block, bool linked)
+	{
+		// Cases breaking out of the switch return to the main loop
 		switch (block->BlockType) {
 
 		case BET_StaticJump:
 		case BET_StaticCall:
-			//next_pc = block->BranchBlock;
-			mov(dword[rax], block->BranchBlock);
-			break;
+			if (!linked)
+			{
+				//next_pc = block->BranchBlock;
+				mov(rax, (size_t)&next_pc);
+				mov(dword[rax], block->BranchBlock);
+				break;
+			}
+			if (block->BlockType == BET_StaticCall)
+				genReturnStackPush();
+			genBlockEpilog();
+			genLinkedJump(block->pBranchBlock, block->BranchBlock, linkBlockBranchStub);
+			return;
 
 		case BET_Cond_0:
 		case BET_Cond_1:
@@ -510,8 +581,13 @@ public:
 				//next_pc = next_pc_value;
 				//if (*jdyn == 0)
 				//next_pc = branch_pc_value;
-
-				mov(dword[rax], block->NextBlock);
+				if (linked)
+					genBlockEpilog();
+				else
+				{
+					mov(rax, (size_t)&next_pc);
+					mov(dword[rax], block->NextBlock);
+				}
 
 				if (block->has_jcond)
 					mov(rdx, (size_t)&Sh4cntx.jdyn);
@@ -521,23 +597,63 @@ public:
 				cmp(dword[rdx], block->BlockType & 1);
 				Xbyak::Label branch_not_taken;
 
-				jne(branch_not_taken, T_SHORT);
-				mov(dword[rax], block->BranchBlock);
+				if (!linked)
+				{
+					jne(branch_not_taken, T_SHORT);
+					mov(dword[rax], block->BranchBlock);
+					L(branch_not_taken);
+					break;
+				}
+				jne(branch_not_taken, T_NEAR);
+				genLinkedJump(block->pBranchBlock, block->BranchBlock, linkBlockBranchStub);
 				L(branch_not_taken);
+				genLinkedJump(block->pNextBlock, block->NextBlock, linkBlockNextStub);
 			}
-			break;
+			return;
 
 		case BET_DynamicJump:
 		case BET_DynamicCall:
 		case BET_DynamicRet:
-			//next_pc = *jdyn;
-			mov(rdx, (size_t)&Sh4cntx.jdyn);
-			mov(edx, dword[rdx]);
-			mov(dword[rax], edx);
-			break;
+			{
+				if (linked && block->BlockType == BET_DynamicCall)
+					genReturnStackPush();
+				//next_pc = *jdyn;
+				mov(rdx, (size_t)&Sh4cntx.jdyn);
+				mov(edx, dword[rdx]);
+				mov(rax, (size_t)&next_pc);
+				mov(dword[rax], edx);
+				if (!linked)
+					break;
+				genBlockEpilog();
+				// Always pop so that the shadow stack follows the guest call chain, even when returning to the main loop
+				if (block->BlockType == BET_DynamicRet)
+					genReturnStackPop();
+
+				Xbyak::Label no_cycles;
+				mov(rax, (uintptr_t)&cycle_counter);
+				cmp(dword[rax], 0);
+				jle(no_cycles, T_NEAR);
+				if (block->BlockType == BET_DynamicRet)
+				{
+					Xbyak::Label lookup;
+					test(r9, r9);
+					jz(lookup);
+					jmp(r9);
+					L(lookup);
+				}
+				// jump to fpcb[(next_pc >> 1) & FPCB_MASK]
+				shr(edx, 1);
+				and_(edx, FPCB_MASK);
+				mov(rax, (uintptr_t)p_sh4rcb->fpcb);
+				jmp(qword[rax + rdx * 8]);
+				L(no_cycles);
+				ret();
+			}
+			return;
 
 		case BET_DynamicIntr:
 		case BET_StaticIntr:
+			mov(rax, (size_t)&next_pc);
 			if (block->BlockType == BET_DynamicIntr) {
 				//next_pc = *jdyn;
 				mov(rdx, (size_t)&Sh4cntx.jdyn);
@@ -556,20 +672,11 @@ public:
 			die("Invalid block end type");
 		}
 
-		L(exit_block);
-#ifdef _WIN32
-		add(rsp, 0x28);
-#else
-		add(rsp, 0x8);
-#endif
+		// Block linking is disabled with the mmu, so exit_block is only used by unlinked blocks
+		if (!linked)
+			L(exit_block);
+		genBlockEpilog();
 		ret();
-
-		ready();
-
-		block->code = (DynarecCodeEntryPtr)getCode();
-		block->host_code_size = getSize();
-
-		emit_Skip(getSize());
 	}
 
 	void ngen_CC_Start(const shil_opcode& op)
@@ -739,6 +846,29 @@ public:
 		mov(rsp, qword[rip + &jmp_rsp]);
 		jmp(run_loop);
 
+		// Block linking stubs. The return address identifies the calling block.
+		Xbyak::Label linkBlockShared;
+		linkBlockBranchStub = getCurr();
+		mov(call_regs[1], 1);
+		jmp(linkBlockShared);
+		linkBlockNextStub = getCurr();
+		mov(call_regs[1], 0);
+		L(linkBlockShared);
+		pop(call_regs64[0]);
+		sub(call_regs64[0], 5);		// go before the call
+#ifdef _WIN32
+		sub(rsp, 0x28);
+#else
+		sub(rsp, 0x8);
+#endif
+		call(rdv_LinkBlock);
+#ifdef _WIN32
+		add(rsp, 0x28);
+#else
+		add(rsp, 0x8);
+#endif
+		jmp(rax);
+
 		genMemHandlers();
 
 		ready();
@@ -1199,6 +1329,10 @@ private:
 					}
 					else
 					{
+#ifdef FAST_MMU
+						if (mmu_enabled() && config::DynarecMmuTlb && _nvmem_enabled())
+							genMmuTlbAccess(size, op);
+#endif
 						// Slow path
 						if (op == MemOp::R)
 						{
@@ -1278,6 +1412,67 @@ private:
 		MemHandlerEnd = getCurr();
 	}
 
+#ifdef FAST_MMU
+	// Accesses the memory directly if the address is found in the inline TLB
+	void genMmuTlbAccess(int size, int op)
+	{
+		static_assert(sizeof(MmuTlbEntry) == 16, "MmuTlbEntry size must be 16");
+		Xbyak::Label miss;
+		if (size != MemSize::S8)
+		{
+			// Misaligned accesses raise an exception
+			test(call_regs[0], (1 << size) - 1);
+			jnz(miss);
+		}
+		mov(r10, (uintptr_t)&CCN_PTEH.reg_data);
+		movzx(r10d, byte[r10]);		// ASID
+		// index: see mmu_tlb_index()
+		mov(eax, call_regs[0]);
+		shr(eax, 12);
+		xor_(eax, r10d);
+		and_(eax, MMU_TLB_SIZE - 1);
+		shl(eax, 4);
+		mov(r9, (uintptr_t)mmuTlb);
+		add(r9, rax);
+		mov(eax, call_regs[0]);
+		and_(eax, ~0xFFF);
+		or_(eax, r10d);
+		cmp(eax, dword[r9 + offsetof(MmuTlbEntry, tag)]);
+		jne(miss);
+		mov(r9, qword[r9 + offsetof(MmuTlbEntry, offset)]);
+		mov(eax, call_regs[0]);
+		switch (size)
+		{
+		case MemSize::S8:
+			if (op == MemOp::R)
+				movsx(eax, byte[r9 + rax]);
+			else
+				mov(byte[r9 + rax], call_regs[1].cvt8());
+			break;
+		case MemSize::S16:
+			if (op == MemOp::R)
+				movsx(eax, word[r9 + rax]);
+			else
+				mov(word[r9 + rax], call_regs[1].cvt16());
+			break;
+		case MemSize::S32:
+			if (op == MemOp::R)
+				mov(eax, dword[r9 + rax]);
+			else
+				mov(dword[r9 + rax], call_regs[1]);
+			break;
+		case MemSize::S64:
+			if (op == MemOp::R)
+				mov(rax, qword[r9 + rax]);
+			else
+				mov(qword[r9 + rax], call_regs64[1]);
+			break;
+		}
+		ret();
+		L(miss);
+	}
+#endif
+
 	void saveXmmRegisters()
 	{
 #ifndef _WIN32
@@ -1368,6 +1563,181 @@ private:
 			restoreXmmRegisters();
 	}
 
+	void genBlockEpilog()
+	{
+#ifdef _WIN32
+		add(rsp, 0x28);
+#else
+		add(rsp, 0x8);
+#endif
+	}
+
+	// Products and sums are done in double precision like the interpreter,
+	// with the same order of operations so that results are identical.
+	void genFipr(const shil_opcode& op)
+	{
+		mov(rax, (uintptr_t)op.rs1.reg_ptr());
+		mov(rcx, (uintptr_t)op.rs2.reg_ptr());
+		if (cpu.has(Cpu::tAVX))
+		{
+			vcvtps2pd(ymm0, xword[rax]);
+			vcvtps2pd(ymm1, xword[rcx]);
+			vmulpd(ymm0, ymm0, ymm1);
+			vextractf128(xmm1, ymm0, 1);
+			vzeroupper();
+		}
+		else
+		{
+			cvtps2pd(xmm0, qword[rax]);
+			cvtps2pd(xmm2, qword[rcx]);
+			mulpd(xmm0, xmm2);
+			cvtps2pd(xmm1, qword[rax + 8]);
+			cvtps2pd(xmm2, qword[rcx + 8]);
+			mulpd(xmm1, xmm2);
+		}
+		// ((p0 + p1) + p2) + p3
+		movapd(xmm2, xmm0);
+		unpckhpd(xmm2, xmm2);
+		addsd(xmm0, xmm2);
+		addsd(xmm0, xmm1);
+		unpckhpd(xmm1, xmm1);
+		addsd(xmm0, xmm1);
+		cvtsd2ss(xmm0, xmm0);
+		host_reg_to_shil_param(op.rd, xmm0);
+	}
+
+	// With AVX, the xmtrx columns are converted to double in ymm2-ymm5 once for consecutive ftrv ops
+	void genFtrv(const shil_opcode& op)
+	{
+		mov(rax, (uintptr_t)op.rs1.reg_ptr());
+		if (cpu.has(Cpu::tAVX))
+		{
+			if (!xmtrxLoaded)
+			{
+				mov(rcx, (uintptr_t)op.rs2.reg_ptr());
+				for (int j = 0; j < 4; j++)
+					vcvtps2pd(Xbyak::Ymm(2 + j), xword[rcx + j * 16]);
+				xmtrxLoaded = true;
+			}
+			// fd[i] = xf[i] * fn[0] + xf[4 + i] * fn[1] + xf[8 + i] * fn[2] + xf[12 + i] * fn[3]
+			for (int j = 0; j < 4; j++)
+			{
+				const Xbyak::Ymm& product = j == 0 ? ymm0 : ymm1;
+				vbroadcastss(Xbyak::Xmm(product.getIdx()), dword[rax + j * 4]);
+				vcvtps2pd(product, Xbyak::Xmm(product.getIdx()));
+				vmulpd(product, product, Xbyak::Ymm(2 + j));
+				if (j != 0)
+					vaddpd(ymm0, ymm0, ymm1);
+			}
+			vcvtpd2ps(xmm0, ymm0);
+			mov(rax, (uintptr_t)op.rd.reg_ptr());
+			vmovups(xword[rax], xmm0);
+		}
+		else
+		{
+			mov(rcx, (uintptr_t)op.rs2.reg_ptr());
+			// low and high halves of the result in xmm0 and xmm1
+			for (int j = 0; j < 4; j++)
+			{
+				cvtss2sd(xmm2, dword[rax + j * 4]);
+				unpcklpd(xmm2, xmm2);
+				const Xbyak::Xmm& lo = j == 0 ? xmm0 : xmm3;
+				const Xbyak::Xmm& hi = j == 0 ? xmm1 : xmm4;
+				cvtps2pd(lo, qword[rcx + j * 16]);
+				mulpd(lo, xmm2);
+				cvtps2pd(hi, qword[rcx + j * 16 + 8]);
+				mulpd(hi, xmm2);
+				if (j != 0)
+				{
+					addpd(xmm0, xmm3);
+					addpd(xmm1, xmm4);
+				}
+			}
+			cvtpd2ps(xmm0, xmm0);
+			cvtpd2ps(xmm1, xmm1);
+			movlhps(xmm0, xmm1);
+			mov(rax, (uintptr_t)op.rd.reg_ptr());
+			movups(xword[rax], xmm0);
+		}
+	}
+
+	void releaseXmtrx()
+	{
+		if (xmtrxLoaded)
+		{
+			vzeroupper();
+			xmtrxLoaded = false;
+		}
+	}
+
+	// Pushes the return address of a call, set in pr, on the shadow return stack
+	void genReturnStackPush()
+	{
+		static_assert(sizeof(ReturnStackEntry) == 16, "Unexpected ReturnStackEntry size");
+		mov(rax, (uintptr_t)&pr);
+		mov(edx, dword[rax]);
+		mov(rax, (uintptr_t)&bm_ReturnStackTop);
+		mov(ecx, dword[rax]);
+		inc(ecx);
+		and_(ecx, RETURN_STACK_SIZE - 1);
+		mov(dword[rax], ecx);
+		shl(ecx, 4);
+		mov(rax, (uintptr_t)&bm_ReturnStack[0]);
+		add(rcx, rax);
+		mov(dword[rcx + offsetof(ReturnStackEntry, pc)], edx);
+		// code at fpcb[(pr >> 1) & FPCB_MASK]
+		shr(edx, 1);
+		and_(edx, FPCB_MASK);
+		mov(rax, (uintptr_t)p_sh4rcb->fpcb);
+		mov(rax, qword[rax + rdx * 8]);
+		mov(qword[rcx + offsetof(ReturnStackEntry, code)], rax);
+	}
+
+	// Pops the shadow return stack. If its address matches the one in edx, r9 is set to its code.
+	// Otherwise r9 is set to 0.
+	void genReturnStackPop()
+	{
+		mov(rax, (uintptr_t)&bm_ReturnStackTop);
+		mov(ecx, dword[rax]);
+		lea(r8d, ptr[ecx - 1]);
+		and_(r8d, RETURN_STACK_SIZE - 1);
+		mov(dword[rax], r8d);
+		shl(ecx, 4);
+		mov(rax, (uintptr_t)&bm_ReturnStack[0]);
+		add(rcx, rax);
+		Xbyak::Label miss;
+		Xbyak::Label done;
+		cmp(edx, dword[rcx + offsetof(ReturnStackEntry, pc)]);
+		jne(miss);
+		mov(rax, (uintptr_t)&prof.counters.bm.callstack_hit);
+		inc(dword[rax]);
+		mov(r9, qword[rcx + offsetof(ReturnStackEntry, code)]);
+		jmp(done);
+		L(miss);
+		mov(rax, (uintptr_t)&prof.counters.bm.callstack_miss);
+		inc(dword[rax]);
+		xor_(r9d, r9d);
+		L(done);
+	}
+
+	// Jumps to the target block if enough cycles are left, otherwise returns to the main loop.
+	// Unlinked blocks call a stub that compiles and links the target.
+	void genLinkedJump(RuntimeBlockInfo *target, u32 pc, const void *linkStub)
+	{
+		Xbyak::Label no_cycles;
+		mov(rax, (uintptr_t)&cycle_counter);
+		cmp(dword[rax], 0);
+		jle(no_cycles, T_NEAR);
+		if (target != nullptr)
+			jmp((const void *)target->code, T_NEAR);
+		else
+			call(linkStub);
+		L(no_cycles);
+		mov(rax, (size_t)&next_pc);
+		mov(dword[rax], pc);
+		ret();
+	}
+
 	struct CC_PS
 	{
 		CanonicalParamType type;
@@ -1378,6 +1748,7 @@ private:
 	X64RegAlloc regalloc;
 	Xbyak::util::Cpu cpu;
 	size_t current_opid;
+	bool xmtrxLoaded = false;
 	Xbyak::Label exit_block;
 };
 
@@ -1398,6 +1769,22 @@ void X64RegAlloc::Writeback_FPU(u32 reg, s8 nreg)
 	compiler->RegWriteback_FPU(reg, nreg);
 }
 
+u32 DynaRBI::Relink()
+{
+	if (relink_offset == 0)
+		// not linkable
+		return 0;
+	BlockCompiler compiler((u8 *)code + relink_offset, host_code_size - relink_offset);
+	try {
+		compiler.genBlockEnd(this, true);
+		compiler.ready();
+	} catch (const Xbyak::Error& e) {
+		ERROR_LOG(DYNAREC, "Fatal xbyak error: %s", e.what());
+		die("Block relinking failed");
+	}
+	return compiler.getSize();
+}
+
 static BlockCompiler* ccCompiler;
 
 void ngen_Compile(RuntimeBlockInfo* block, bool smc_checks, bool reset, bool staging, bool optimise)
@@ -30,6 +30,7 @@ class BaseXbyakRec : public Xbyak::CodeGenerator
 protected:
 	BaseXbyakRec() : BaseXbyakRec((u8 *)emit_GetCCPtr()) { }
 	BaseXbyakRec(u8 *code_ptr) : Xbyak::CodeGenerator(emit_FreeSpace(), code_ptr) { }
+	BaseXbyakRec(u8 *code_ptr, size_t size) : Xbyak::CodeGenerator(size, code_ptr) { }
 
 	using BinaryOp = void (BaseXbyakRec::*)(const Xbyak::Operand&, const Xbyak::Operand&);
 	using BinaryFOp = void (BaseXbyakRec::*)(const Xbyak::Xmm&, const Xbyak::Operand&);
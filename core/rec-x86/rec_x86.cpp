@@ -37,6 +37,7 @@ static void (*ngen_LinkBlock_cond_Next_stub)();
 static void (*ngen_LinkBlock_cond_Branch_stub)();
 static void (*ngen_LinkBlock_Generic_stub)();
 static void (*ngen_blockcheckfail)();
+static void (*ngen_blockhot)();
 
 static X86Compiler* compiler;
 
@@ -85,12 +86,18 @@ RuntimeBlockInfo* ngen_AllocateBlock()
 	return new DynaRBI();
 }
 
-void X86Compiler::compile(RuntimeBlockInfo* block, bool force_checks, bool optimise)
+void X86Compiler::compile(RuntimeBlockInfo* block, bool force_checks, bool staging, bool optimise)
 {
 	DEBUG_LOG(DYNAREC, "X86 compiling %08x to %p", block->addr, emit_GetCCPtr());
 	current_opid = -1;
 
 	checkBlock(force_checks, block);
+	if (staging)
+	{
+		mov(ecx, block->addr);
+		sub(dword[&block->staging_runs], 1);
+		jz((const void *)ngen_blockhot);
+	}
 
 	sub(dword[&cycle_counter], block->guest_cycles);
 	Xbyak::Label no_up;
@@ -455,6 +462,12 @@ void X86Compiler::genMainloop()
 	call((void *)rdv_BlockCheckFail);
 	jmp(eax);
 
+//ngen_blockhot:
+	Xbyak::Label ngen_blockhotLabel;
+	L(ngen_blockhotLabel);
+	call((void *)rdv_BlockHot);
+	jmp(eax);
+
 	genMemHandlers();
 
 	ready();
@@ -467,6 +480,7 @@ void X86Compiler::genMainloop()
 	ngen_LinkBlock_cond_Branch_stub = (void (*)())ngen_LinkBlock_cond_Branch_label.getAddress();
 	ngen_LinkBlock_Generic_stub = (void (*)())ngen_LinkBlock_Generic_label.getAddress();
 	ngen_blockcheckfail = (void (*)())ngen_blockcheckfailLabel.getAddress();
+	ngen_blockhot = (void (*)())ngen_blockhotLabel.getAddress();
 
 	emit_Skip(getSize());
 }
@@ -737,14 +751,14 @@ void ngen_mainloop(void* v_cntx)
 	}
 }
 
-void ngen_Compile(RuntimeBlockInfo* block, bool smc_checks, bool, bool, bool optimise)
+void ngen_Compile(RuntimeBlockInfo* block, bool smc_checks, bool, bool staging, bool optimise)
 {
 	verify(emit_FreeSpace() >= 16 * 1024);
 
 	compiler = new X86Compiler();
 
 	try {
-		compiler->compile(block, smc_checks, optimise);
+		compiler->compile(block, smc_checks, staging, optimise);
 	} catch (const Xbyak::Error& e) {
 		ERROR_LOG(DYNAREC, "Fatal xbyak error: %s", e.what());
 	}
@@ -36,7 +36,7 @@ public:
 	X86Compiler() : BaseCompiler(), regalloc(this) { }
 	X86Compiler(u8 *code_ptr) : BaseCompiler(code_ptr), regalloc(this) { }
 
-	void compile(RuntimeBlockInfo* block, bool force_checks, bool optimise);
+	void compile(RuntimeBlockInfo* block, bool force_checks, bool staging, bool optimise);
 
 	void ngen_CC_Start(const shil_opcode& op)
 	{
@@ -447,6 +447,15 @@ static void gui_display_commands()
 		gui_state = GuiState::Cheats;
 	}
 	ImGui::Columns(1, nullptr, false);
+	if (config::RewindEnabled)
+	{
+		if (ImGui::Button("Rewind", ImVec2(300 * scaling + ImGui::GetStyle().ColumnsMinSpacing + ImGui::GetStyle().FramePadding.x * 2 - 1,
+				50 * scaling)))
+		{
+			gui_state = GuiState::Closed;
+			dc_rewind();
+		}
+	}
 	if (ImGui::Button("Exit", ImVec2(300 * scaling + ImGui::GetStyle().ColumnsMinSpacing + ImGui::GetStyle().FramePadding.x * 2 - 1,
 			50 * scaling)))
 	{
@@ -1009,6 +1018,12 @@ static void gui_display_settings()
 				scanner.refresh();
 			OptionCheckbox("Auto load/save state", config::AutoSavestate,
 					"Automatically save the state of the game when stopping and load it at start up.");
+			OptionCheckbox("Rewind", config::RewindEnabled,
+					"Periodically keep a snapshot of the game in memory so that it can be rewound from the menu.");
+			OptionSlider("Rewind Depth", config::RewindDepth, 1, 300,
+					"Number of snapshots kept in memory");
+			OptionSlider("Rewind Interval", config::RewindInterval, 1, 300,
+					"Number of frames between two snapshots");
 
 			ImGui::PopStyleVar();
 			ImGui::EndTabItem();
@@ -1344,6 +1359,14 @@ static void gui_display_settings()
 			OptionCheckbox("Disable Sound", config::DisableSound, "Disable the emulator sound output");
 			OptionCheckbox("Enable DSP", config::DSPEnabled,
 					"Enable the Dreamcast Digital Sound Processor. Only recommended on fast platforms");
+			OptionCheckbox("Threaded Sound", config::ThreadedAica,
+					"Run the sound CPU and sound generation on a separate thread. Recommended on multi-core platforms");
+			OptionCheckbox("Dynamic Rate Control", config::DynamicRateControl,
+					"Buffer the audio output instead of waiting for the audio driver, and slightly raise the audio rate when the buffer runs low. Reduces crackling when the game speed doesn't exactly match the audio clock");
+			AudioStats audioStats = GetAudioStats();
+			if (audioStats.capacity != 0)
+				ImGui::Text("Buffer: %d%%  Rate: %.4f  Underruns: %d  Overruns: %d", audioStats.fill * 100 / audioStats.capacity,
+						audioStats.ratio, (int)audioStats.underruns, (int)audioStats.overruns);
 #if !defined(_WIN32)
 #ifdef __ANDROID__
             OptionCheckbox("Automatic Latency", config::AutoLatency,
@@ -1465,6 +1488,12 @@ static void gui_display_settings()
 		    	OptionCheckbox("Safe Mode", config::DynarecSafeMode,
 		    			"Do not optimize integer division. Not recommended");
 		    	OptionCheckbox("Idle Skip", config::DynarecIdleSkip, "Skip wait loops. Recommended");
+		    	OptionCheckbox("Block Cache", config::DynarecBlockCache,
+		    			"Save decoded code to disk to speed up the next game start");
+		    	OptionCheckbox("Superblocks", config::DynarecSuperblocks,
+		    			"Optimize chains of hot blocks linked by jumps, calls and returns as a whole");
+		    	OptionCheckbox("Background Compilation", config::DynarecAsyncCompile,
+		    			"Decode new blocks on another thread and interpret them meanwhile. x64 only");
 		    }
 		    if (ImGui::CollapsingHeader("Network", ImGuiTreeNodeFlags_DefaultOpen))
 		    {
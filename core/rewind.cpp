@@ -0,0 +1,201 @@
+/*
+	Copyright 2026 Flycast contributors
+
+	This file is part of Flycast.
+
+    Flycast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    Flycast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Flycast.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "rewind.h"
+#include "emulator.h"
+#include "cfg/option.h"
+#include "hw/sh4/sh4_if.h"
+
+#include <deque>
+
+bool dc_serialize(void **data, unsigned int *total_size);
+
+namespace rewinder
+{
+
+// Memory used by the deltas is bounded regardless of the configured depth
+static constexpr size_t MaxMemory = 256 * 1024 * 1024;
+
+static std::vector<u8> latest;
+static std::vector<u8> scratch;
+// XOR of consecutive snapshots, oldest first. back() is the delta between latest and the previous snapshot.
+static std::deque<std::vector<u8>> deltas;
+static size_t deltasSize;
+static u32 frames;
+static bool pending;
+
+static inline u64 load64(const u8 *p)
+{
+	u64 v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static void put32(std::vector<u8>& out, u32 v)
+{
+	out.insert(out.end(), (const u8 *)&v, (const u8 *)&v + sizeof(v));
+}
+
+// Encodes a ^ b as a sequence of [zero run length][literal length][literal bytes]
+static void encodeDelta(const u8 *a, const u8 *b, size_t size, std::vector<u8>& out)
+{
+	out.clear();
+	size_t i = 0;
+	while (i < size)
+	{
+		size_t zeroStart = i;
+		while (i + 8 <= size && load64(a + i) == load64(b + i))
+			i += 8;
+		size_t litStart = i;
+		while (i < size && (i + 8 > size || load64(a + i) != load64(b + i)))
+			i = std::min(i + 8, size);
+		put32(out, (u32)(litStart - zeroStart));
+		put32(out, (u32)(i - litStart));
+		size_t pos = out.size();
+		out.resize(pos + i - litStart);
+		for (size_t j = litStart; j < i; j++)
+			out[pos++] = a[j] ^ b[j];
+	}
+	out.shrink_to_fit();
+}
+
+// data ^= delta
+static void applyDelta(const std::vector<u8>& delta, u8 *data)
+{
+	const u8 *p = delta.data();
+	const u8 *end = p + delta.size();
+	while (p < end)
+	{
+		u32 zeros, literals;
+		memcpy(&zeros, p, sizeof(zeros));
+		memcpy(&literals, p + 4, sizeof(literals));
+		p += 8;
+		data += zeros;
+		for (u32 i = 0; i < literals; i++)
+			data[i] ^= p[i];
+		data += literals;
+		p += literals;
+	}
+}
+
+void reset()
+{
+	latest.clear();
+	scratch.clear();
+	deltas.clear();
+	deltasSize = 0;
+	frames = 0;
+	pending = false;
+}
+
+static void eventCallback(Event event)
+{
+	// Snapshots taken before are unrelated to the new state
+	reset();
+}
+
+void init()
+{
+	EventManager::listen(Event::Start, eventCallback);
+	EventManager::listen(Event::Terminate, eventCallback);
+	EventManager::listen(Event::LoadState, eventCallback);
+}
+
+void term()
+{
+	EventManager::unlisten(Event::Start, eventCallback);
+	EventManager::unlisten(Event::Terminate, eventCallback);
+	EventManager::unlisten(Event::LoadState, eventCallback);
+	reset();
+	latest.shrink_to_fit();
+	scratch.shrink_to_fit();
+}
+
+void vblank()
+{
+	if (!config::RewindEnabled || pending)
+		return;
+	if (++frames < (u32)std::max(1, config::RewindInterval.get()))
+		return;
+	frames = 0;
+	pending = true;
+	// The state is only consistent between two cpu runs
+	sh4_cpu.Stop();
+}
+
+bool capturePending()
+{
+	return pending;
+}
+
+void capture()
+{
+	pending = false;
+	unsigned int size = 0;
+	void *data = nullptr;
+	if (!dc_serialize(&data, &size))
+		return;
+	scratch.resize(size);
+	data = scratch.data();
+	dc_serialize(&data, &size);
+
+	if (latest.size() != size || config::RewindDepth <= 1)
+	{
+		// First snapshot or the state layout has changed
+		deltas.clear();
+		deltasSize = 0;
+		latest.swap(scratch);
+		return;
+	}
+	std::vector<u8> delta;
+	encodeDelta(latest.data(), scratch.data(), size, delta);
+	latest.swap(scratch);
+	deltasSize += delta.size();
+	deltas.push_back(std::move(delta));
+	while (deltas.size() >= (size_t)config::RewindDepth || (deltasSize > MaxMemory && deltas.size() > 1))
+	{
+		deltasSize -= deltas.front().size();
+		deltas.pop_front();
+	}
+	DEBUG_LOG(SAVESTATE, "Rewind: %d snapshots, %d KB", (int)deltas.size() + 1, (int)((deltasSize + latest.size()) / 1024));
+}
+
+bool available()
+{
+	return !latest.empty();
+}
+
+bool pop(std::vector<u8>& state)
+{
+	if (latest.empty())
+		return false;
+	state = latest;
+	if (deltas.empty())
+		latest.clear();
+	else
+	{
+		applyDelta(deltas.back(), latest.data());
+		deltasSize -= deltas.back().size();
+		deltas.pop_back();
+	}
+	frames = 0;
+
+	return true;
+}
+
+}
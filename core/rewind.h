@@ -0,0 +1,43 @@
+/*
+	Copyright 2026 Flycast contributors
+
+	This file is part of Flycast.
+
+    Flycast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    Flycast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Flycast.  If not, see <https://www.gnu.org/licenses/>.
+*/
+// In-memory rewind buffer.
+// The machine state is captured every few frames. The most recent snapshot is kept as is
+// and older ones are stored as run-length encoded XOR deltas between consecutive snapshots.
+#pragma once
+#include "types.h"
+
+namespace rewinder
+{
+
+void init();
+void term();
+
+// Called on each vblank by the emulator thread. Stops the cpu when a snapshot is due.
+void vblank();
+// True if the cpu has been stopped to take a snapshot
+bool capturePending();
+// Takes a snapshot. The cpu must be stopped.
+void capture();
+
+bool available();
+// Moves the most recent snapshot into state and removes it from the buffer
+bool pop(std::vector<u8>& state);
+void reset();
+
+}
@@ -0,0 +1,283 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "hw/aica/aica_if.h"
+#include "hw/aica/aica.h"
+#include "hw/aica/dsp.h"
+#include "hw/arm7/arm7.h"
+#include "hw/sh4/sh4_if.h"
+#include "hw/sh4/sh4_core.h"
+#include "hw/sh4/sh4_sched.h"
+#include "hw/sh4/sh4_mem.h"
+#include "hw/mem/_vmem.h"
+#include "oslib/audiostream.h"
+#include "emulator.h"
+#include "cfg/option.h"
+
+#include <vector>
+
+void Get_Sh4Interpreter(sh4_if* cpu);
+
+namespace {
+
+constexpr u32 CodeAddress = 0x8c010000;
+constexpr int AicaTick = 145125;
+
+// Sets the pitch of channel 0 to the current timer A count in a loop.
+// Only the value read after each batch of samples matters, so the output doesn't depend on the sh4 timing.
+const u16 Program[] = {
+	0xD303,		// mov.l @(0x10), r3
+	0xD404,		// mov.l @(0x14), r4
+// loop:
+	0x6531,		// mov.w @r3, r5
+	0x2451,		// mov.w r5, @r4
+	0xAFFC,		// bra loop
+	0x0009,		// nop
+	0x0009,		// nop
+	0x0009,		// nop
+// 0x10:
+	0x2890, 0xA070,		// timer A
+	0x0018, 0xA070,		// channel 0 FNS/OCT
+};
+
+// Increments a counter in aica ram
+const u32 ArmProgram[] = {
+	0xe3a00000,	// mov r0, #0
+	0xe3a01c01,	// mov r1, #0x100
+// loop:
+	0xe2800001,	// add r0, r0, #1
+	0xe5810000,	// str r0, [r1]
+	0xeafffffc,	// b loop
+};
+
+constexpr u32 WaveAddress = 0x1000;
+constexpr u32 WaveLength = 64;
+
+std::vector<std::vector<u32>> chunks;
+
+void captureInit() {
+}
+
+u32 capturePush(const void *data, u32 frames, bool wait)
+{
+	const u32 *p = (const u32 *)data;
+	chunks.emplace_back(p, p + frames);
+	return frames;
+}
+
+void captureTerm() {
+}
+
+audiobackend_t captureBackend = {
+		"test", // Slug
+		"Test capture", // Name
+		&captureInit,
+		&capturePush,
+		&captureTerm,
+		nullptr,
+		nullptr,
+		nullptr,
+		nullptr,
+};
+bool captureRegistered = RegisterAudioBackend(&captureBackend);
+
+int stopCallback(int tag, int cycles, int jitter)
+{
+	sh4_cpu.Stop();
+	return 0;
+}
+
+}
+
+class AicaTest : public ::testing::Test {
+protected:
+	void SetUp() override {
+		if (virt_ram_base == nullptr && !_vmem_reserve())
+			die("_vmem_reserve failed");
+		dc_init();
+		mem_map_default();
+		static int schedId = sh4_sched_register(0, stopCallback);
+		this->schedId = schedId;
+	}
+
+	void startSound()
+	{
+		dc_reset(true);
+		memcpy(&aica_ram[0], ArmProgram, sizeof(ArmProgram));
+		for (u32 i = 0; i < WaveLength; i++)
+			*(s16 *)&aica_ram[WaveAddress + i * 2] = (s16)(i * 1000 - 32000);
+		// MVOL
+		WriteMem_aica_reg(0x2800, 0xF, 2);
+		// SA, LSA, LEA, AR, RR, IMXL, DISDL
+		WriteMem_aica_reg(0x04, WaveAddress, 2);
+		WriteMem_aica_reg(0x08, 0, 2);
+		WriteMem_aica_reg(0x0C, WaveLength, 2);
+		WriteMem_aica_reg(0x10, 0x1F, 2);
+		WriteMem_aica_reg(0x14, 0x1F, 2);
+		WriteMem_aica_reg(0x20, 0xF0, 2);
+		WriteMem_aica_reg(0x24, 0xF00, 2);
+		// KYONEX, KYONB, LPCTL, PCM16
+		WriteMem_aica_reg(0x00, 0xC200, 2);
+		// Start the arm
+		WriteMem_aica_reg(0x2C00, 1, 1);
+		WriteMem_aica_reg(0x2C00, 0, 1);
+	}
+
+	// EFREG[efreg] = MIXS0 / 2, mixed at full volume
+	void loadDspProgram(u32 efreg = 0)
+	{
+		// COEF0
+		WriteMem_aica_reg(0x3000, 0x4000, 2);
+		// step 0: XSEL, YSEL=1 (COEF), IRA=0x20 (MIXS0), ZERO
+		WriteMem_aica_reg(0x3404, 0xB000, 2);
+		WriteMem_aica_reg(0x3408, 0x0002, 2);
+		// step 1: EWT, EWA
+		WriteMem_aica_reg(0x3418, 0x1002 | (efreg << 8), 2);
+		// EFSDL0
+		WriteMem_aica_reg(0x2000, 0xF00, 2);
+	}
+
+	std::vector<std::vector<u32>> capture(int ticks, bool dsp = false)
+	{
+		startSound();
+		if (dsp)
+			loadDspProgram();
+		chunks.clear();
+		run(ticks * AicaTick);
+		return chunks;
+	}
+
+	void run(int cycles)
+	{
+		Get_Sh4Interpreter(&sh4_cpu);
+		SetMemoryHandlers();
+		memcpy(GetMemPtr(CodeAddress, sizeof(Program)), Program, sizeof(Program));
+		sh4_cpu.ResetCache();
+		for (int i = 0; i < 16; i++)
+			r[i] = 0;
+		next_pc = CodeAddress;
+		sh4_sched_request(schedId, cycles);
+		sh4_cpu.Start();
+		sh4_cpu.Run();
+		libAICA_Sync();
+	}
+
+	int schedId;
+};
+
+TEST_F(AicaTest, ThreadedDeterminism)
+{
+	config::AudioBackend.set("test");
+	InitAudio();
+	// 16 ticks per 512-frame chunk
+	constexpr int Ticks = 16 * 12;
+
+	std::vector<std::vector<u32>> output[2];
+	u32 armCounter[2];
+	u32 armR0[2];
+	// Keep the aica updates away from the start and end of the runs
+	run(AicaTick / 2);
+	for (int threaded = 0; threaded < 2; threaded++)
+	{
+		config::ThreadedAica.set(threaded == 1);
+		startSound();
+		chunks.clear();
+		run(Ticks * AicaTick);
+		output[threaded] = chunks;
+		armCounter[threaded] = *(u32 *)&aica_ram[0x100];
+		armR0[threaded] = arm_Reg[0].I;
+	}
+	config::ThreadedAica.reset();
+	TermAudio();
+	config::AudioBackend.reset();
+
+	// The first chunk also holds the samples left over from before the run
+	ASSERT_EQ(output[0].size(), output[1].size());
+	ASSERT_LE(2u, output[0].size());
+	bool silent = true;
+	for (size_t i = 1; i < output[0].size(); i++)
+	{
+		ASSERT_TRUE(output[0][i] == output[1][i]) << "chunk " << i;
+		for (u32 frame : output[0][i])
+			silent = silent && frame == 0;
+	}
+	ASSERT_FALSE(silent);
+	ASSERT_NE(0u, armCounter[0]);
+	ASSERT_EQ(armCounter[0], armCounter[1]);
+	ASSERT_EQ(armR0[0], armR0[1]);
+}
+
+TEST_F(AicaTest, BatchedDsp)
+{
+	config::AudioBackend.set("test");
+	InitAudio();
+	constexpr int Ticks = 16 * 12;
+	const bool noBatch = settings.aica.NoBatch;
+
+	run(AicaTick / 2);
+	config::DSPEnabled.set(true);
+	settings.aica.NoBatch = true;
+	std::vector<std::vector<u32>> perSample = capture(Ticks, true);
+	settings.aica.NoBatch = false;
+	std::vector<std::vector<u32>> batched = capture(Ticks, true);
+	config::DSPEnabled.reset();
+	std::vector<std::vector<u32>> noDsp = capture(Ticks);
+	settings.aica.NoBatch = noBatch;
+	TermAudio();
+	config::AudioBackend.reset();
+
+	// The first chunk also holds the samples left over from before the run
+	ASSERT_EQ(perSample.size(), batched.size());
+	ASSERT_LE(2u, batched.size());
+	bool dspOutput = false;
+	for (size_t i = 1; i < batched.size(); i++)
+	{
+		ASSERT_TRUE(perSample[i] == batched[i]) << "chunk " << i;
+		dspOutput = dspOutput || batched[i] != noDsp[i];
+	}
+	ASSERT_TRUE(dspOutput);
+}
+
+#if FEAT_DSPREC != DYNAREC_NONE
+TEST_F(AicaTest, DspProgramCache)
+{
+	dc_reset(true);
+	const DspCacheStats initial = dsp_GetCacheStats();
+	auto runProgram = [this](u32 efreg) {
+		loadDspProgram(efreg);
+		memset(DSPData->EFREG, 0, sizeof(DSPData->EFREG));
+		dsp.MIXS[0] = 0x10000;
+		dsp_step();
+		for (u32 i = 0; i < 16; i++)
+			ASSERT_EQ(i == efreg, DSPData->EFREG[i] != 0) << "efreg " << efreg << " EFREG[" << i << "]";
+	};
+	auto compiles = [&initial]() { return dsp_GetCacheStats().compiles - initial.compiles; };
+	auto hits = [&initial]() { return dsp_GetCacheStats().hits - initial.hits; };
+
+	runProgram(0);
+	runProgram(1);
+	ASSERT_EQ(2u, compiles());
+	// Switching back to known programs doesn't recompile
+	runProgram(0);
+	runProgram(1);
+	ASSERT_EQ(2u, compiles());
+	ASSERT_EQ(2u, hits());
+
+	// Fill the cache: program 0 was used more recently than program 1 so program 1 gets evicted
+	runProgram(0);
+	ASSERT_EQ(3u, hits());
+	for (u32 efreg = 2; efreg < DSP_CACHE_SLOTS + 1; efreg++)
+		runProgram(efreg);
+	ASSERT_EQ((u64)DSP_CACHE_SLOTS + 1, compiles());
+	runProgram(0);
+	ASSERT_EQ(4u, hits());
+	runProgram(1);
+	ASSERT_EQ((u64)DSP_CACHE_SLOTS + 2, compiles());
+
+	// A different ring buffer needs another compile
+	runProgram(0);
+	ASSERT_EQ(5u, hits());
+	WriteMem_aica_reg(0x2804, 1 << 13, 2);
+	runProgram(0);
+	ASSERT_EQ((u64)DSP_CACHE_SLOTS + 3, compiles());
+}
+#endif
@@ -0,0 +1,196 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "oslib/audiostream.h"
+#include "oslib/spsc_ring.h"
+#include "cfg/option.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace {
+
+std::vector<u32> frames;
+std::atomic<u32> captured;
+std::atomic<bool> blocked;
+
+void captureInit() {
+}
+
+u32 capturePush(const void *data, u32 count, bool wait)
+{
+	while (blocked)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	const u32 *p = (const u32 *)data;
+	frames.insert(frames.end(), p, p + count);
+	captured += count;
+	return count;
+}
+
+void captureTerm() {
+}
+
+audiobackend_t captureBackend = {
+		"test-drc", // Slug
+		"Test rate control capture", // Name
+		&captureInit,
+		&capturePush,
+		&captureTerm,
+		nullptr,
+		nullptr,
+		nullptr,
+		nullptr,
+};
+bool captureRegistered = RegisterAudioBackend(&captureBackend);
+
+}
+
+class AudioStreamTest : public ::testing::Test {
+protected:
+	void SetUp() override
+	{
+		frames.clear();
+		captured = 0;
+		blocked = false;
+		config::AudioBackend.set("test-drc");
+		config::DynamicRateControl.set(true);
+		InitAudio();
+	}
+
+	void TearDown() override
+	{
+		blocked = false;
+		TermAudio();
+		config::DynamicRateControl.reset();
+		config::AudioBackend.reset();
+	}
+
+	void waitForOutput(u32 count)
+	{
+		for (int i = 0; i < 1000 && captured < count; i++)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		ASSERT_LE(count, (u32)captured);
+	}
+};
+
+TEST(SpscRingTest, ReadWrite)
+{
+	SpscRing<u32> ring;
+	ring.init(100);
+	ASSERT_EQ(128u, ring.capacity());
+	ASSERT_EQ(0u, ring.size());
+
+	u32 data[200];
+	for (u32 i = 0; i < 200; i++)
+		data[i] = i;
+	ASSERT_EQ(100u, ring.write(data, 100));
+	ASSERT_EQ(28u, ring.write(data + 100, 50));
+	ASSERT_EQ(128u, ring.size());
+	ASSERT_EQ(0u, ring.write(data, 1));
+
+	u32 out[200];
+	ASSERT_EQ(90u, ring.read(out, 90));
+	for (u32 i = 0; i < 90; i++)
+		ASSERT_EQ(i, out[i]);
+	// Wrap around
+	ASSERT_EQ(72u, ring.write(data + 128, 72));
+	ASSERT_EQ(110u, ring.read(out, 200));
+	for (u32 i = 0; i < 110; i++)
+		ASSERT_EQ(i + 90, out[i]);
+	ASSERT_EQ(0u, ring.size());
+	ASSERT_EQ(0u, ring.read(out, 1));
+}
+
+TEST(SpscRingTest, Threads)
+{
+	constexpr u32 Count = 1000000;
+	SpscRing<u32> ring;
+	ring.init(256);
+	std::thread producer([&ring]() {
+		u32 data[37];
+		u32 next = 0;
+		while (next < Count)
+		{
+			u32 n = std::min<u32>(37, Count - next);
+			for (u32 i = 0; i < n; i++)
+				data[i] = next + i;
+			u32 written = ring.write(data, n);
+			if (written == 0)
+				std::this_thread::yield();
+			next += written;
+		}
+	});
+	u32 expected = 0;
+	bool ordered = true;
+	u32 data[53];
+	while (expected < Count)
+	{
+		u32 n = ring.read(data, 53);
+		if (n == 0)
+			std::this_thread::yield();
+		for (u32 i = 0; i < n; i++)
+			ordered = ordered && data[i] == expected + i;
+		expected += n;
+	}
+	producer.join();
+	ASSERT_TRUE(ordered);
+	ASSERT_EQ(0u, ring.size());
+}
+
+TEST_F(AudioStreamTest, RateControl)
+{
+	// The ring is drained between each chunk: the output rate is slightly increased
+	constexpr u32 Count = SAMPLE_COUNT * 20;
+	for (u32 i = 0; i < Count; i++)
+	{
+		WriteSample((s16)-i, (s16)i);
+		if (i % SAMPLE_COUNT == SAMPLE_COUNT - 1)
+			for (int j = 0; j < 1000 && GetAudioStats().fill != 0; j++)
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	// The output rate is never lower than the input rate here, so all the full chunks are available
+	waitForOutput(Count);
+	AudioStats stats = GetAudioStats();
+	ASSERT_EQ(SAMPLE_COUNT * 4, stats.capacity);
+	ASSERT_GT(stats.ratio, 1.f);
+	ASSERT_EQ(0u, stats.overruns);
+	ASSERT_GE((u32)(Count * 1.005f), frames.size());
+
+	// Resampling a ramp gives a ramp
+	for (size_t i = 1; i < frames.size(); i++)
+	{
+		s16 l = (s16)frames[i];
+		s16 r = (s16)(frames[i] >> 16);
+		ASSERT_LE((s16)frames[i - 1], l) << i;
+		ASSERT_EQ(-l, r) << i;
+	}
+}
+
+TEST_F(AudioStreamTest, FullRing)
+{
+	// The backend doesn't accept anything: the ring fills up and the output rate is slightly decreased
+	blocked = true;
+	// The output thread holds one chunk and the ring gets the next four
+	for (u32 i = 0; i < SAMPLE_COUNT * 5 + 64; i++)
+		WriteSample(0, 0);
+	AudioStats stats = GetAudioStats();
+	ASSERT_EQ(SAMPLE_COUNT * 4, stats.fill);
+	ASSERT_LT(stats.ratio, 1.f);
+	ASSERT_FLOAT_EQ(1.f - 0.005f, stats.ratio);
+
+	// Only a full ring blocks the emulator
+	std::atomic<bool> done { false };
+	std::thread producer([&done]() {
+		for (u32 i = 0; i < SAMPLE_COUNT; i++)
+			WriteSample(0, 0);
+		done = true;
+	});
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	bool doneWhileBlocked = done;
+	blocked = false;
+	producer.join();
+	ASSERT_FALSE(doneWhileBlocked);
+	stats = GetAudioStats();
+	ASSERT_EQ(0u, stats.overruns);
+}
@@ -0,0 +1,103 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "hw/sh4/dyna/block_index.h"
+
+#include <memory>
+#include <vector>
+
+namespace {
+
+struct TestBlock
+{
+	u8 *code;
+	u32 host_code_size;
+};
+using TestBlockPtr = std::shared_ptr<TestBlock>;
+
+TestBlockPtr makeBlock(u8 *code, u32 size)
+{
+	return TestBlockPtr(new TestBlock{ code, size });
+}
+
+}
+
+class BlockIndexTest : public ::testing::Test {
+protected:
+	u8 buffer[0x10000];
+};
+
+TEST_F(BlockIndexTest, FindTest)
+{
+	BlockIndex<TestBlockPtr> index;
+	ASSERT_TRUE(index.empty());
+	ASSERT_EQ(nullptr, index.find(buffer));
+
+	TestBlockPtr b1 = makeBlock(&buffer[0], 100);
+	TestBlockPtr b2 = makeBlock(&buffer[100], 20);
+	TestBlockPtr b3 = makeBlock(&buffer[200], 50);
+	index.add(b1);
+	index.add(b2);
+	index.add(b3);
+	ASSERT_EQ(3u, index.size());
+
+	ASSERT_EQ(b1, index.find(&buffer[0]));
+	ASSERT_EQ(b1, index.find(&buffer[99]));
+	ASSERT_EQ(b2, index.find(&buffer[100]));
+	ASSERT_EQ(b2, index.find(&buffer[119]));
+	ASSERT_EQ(nullptr, index.find(&buffer[120]));
+	ASSERT_EQ(nullptr, index.find(&buffer[199]));
+	ASSERT_EQ(b3, index.find(&buffer[249]));
+	ASSERT_EQ(nullptr, index.find(&buffer[250]));
+
+	index.remove(b2);
+	ASSERT_EQ(2u, index.size());
+	ASSERT_EQ(nullptr, index.find(&buffer[100]));
+	ASSERT_EQ(b1, index.find(&buffer[50]));
+	ASSERT_EQ(b3, index.find(&buffer[200]));
+
+	// Out of order insertion reusing the hole
+	TestBlockPtr b4 = makeBlock(&buffer[100], 10);
+	index.add(b4);
+	ASSERT_EQ(b4, index.find(&buffer[105]));
+	ASSERT_EQ(nullptr, index.find(&buffer[110]));
+	// Out of order insertion
+	TestBlockPtr b5 = makeBlock(&buffer[150], 10);
+	index.add(b5);
+	ASSERT_EQ(b5, index.find(&buffer[150]));
+	ASSERT_EQ(b3, index.find(&buffer[200]));
+
+	std::vector<TestBlockPtr> blocks;
+	index.forEach([&blocks](const TestBlockPtr& block) { blocks.push_back(block); });
+	ASSERT_EQ(4u, blocks.size());
+	ASSERT_EQ(b1, blocks[0]);
+	ASSERT_EQ(b4, blocks[1]);
+	ASSERT_EQ(b5, blocks[2]);
+	ASSERT_EQ(b3, blocks[3]);
+
+	blocks.clear();
+	index.forEachInRange(&buffer[1], &buffer[200], [&blocks](const TestBlockPtr& block) { blocks.push_back(block); });
+	ASSERT_EQ(2u, blocks.size());
+	ASSERT_EQ(b4, blocks[0]);
+	ASSERT_EQ(b5, blocks[1]);
+
+	index.clear();
+	ASSERT_TRUE(index.empty());
+	ASSERT_EQ(nullptr, index.find(&buffer[0]));
+}
+
+TEST_F(BlockIndexTest, OverlapTest)
+{
+	BlockIndex<TestBlockPtr> index(true);
+	TestBlockPtr old1 = makeBlock(&buffer[0], 100);
+	TestBlockPtr old2 = makeBlock(&buffer[100], 100);
+	index.add(old1);
+	index.add(old2);
+	// New cache generation
+	TestBlockPtr new1 = makeBlock(&buffer[0], 150);
+	index.add(new1);
+
+	ASSERT_EQ(new1, index.find(&buffer[50]));
+	ASSERT_EQ(new1, index.find(&buffer[120]));
+	ASSERT_EQ(old2, index.find(&buffer[150]));
+	ASSERT_EQ(nullptr, index.find(&buffer[200]));
+}
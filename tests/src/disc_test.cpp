@@ -0,0 +1,86 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "imgread/common.h"
+
+namespace {
+
+struct TestDisc : Disc
+{
+	TestDisc(FILE *raw, FILE *cooked)
+	{
+		Track t;
+		t.StartFAD = 150;
+		t.EndFAD = 449;
+		t.file = new RawTrackFile(raw, 0, t.StartFAD, 2352);
+		tracks.push_back(t);
+		t.StartFAD = 450;
+		t.EndFAD = 899;
+		t.file = new RawTrackFile(cooked, 0, t.StartFAD, 2048);
+		tracks.push_back(t);
+	}
+};
+
+void fillUserData(u8 *p, u32 fad)
+{
+	for (u32 i = 0; i < 2048; i += 4)
+		*(u32 *)&p[i] = fad * 4096 + i;
+}
+
+}
+
+class DiscTest : public ::testing::Test {
+protected:
+	void TearDown() override
+	{
+		std::remove(rawPath.c_str());
+		std::remove(cookedPath.c_str());
+	}
+
+	const std::string rawPath = "disc_test_raw.bin";
+	const std::string cookedPath = "disc_test_cooked.bin";
+};
+
+TEST_F(DiscTest, ReadSectors)
+{
+	FILE *f = fopen(rawPath.c_str(), "wb");
+	for (u32 fad = 150; fad < 450; fad++)
+	{
+		u8 sector[2352] {};
+		sector[15] = 1;		// mode 1
+		fillUserData(&sector[16], fad);
+		fwrite(sector, sizeof(sector), 1, f);
+	}
+	fclose(f);
+	f = fopen(cookedPath.c_str(), "wb");
+	for (u32 fad = 450; fad < 900; fad++)
+	{
+		u8 sector[2048];
+		fillUserData(sector, fad);
+		fwrite(sector, sizeof(sector), 1, f);
+	}
+	fclose(f);
+
+	TestDisc disc(fopen(rawPath.c_str(), "rb"), fopen(cookedPath.c_str(), "rb"));
+	// Across the track boundary, with an unaligned start
+	const u32 start = 173;
+	const u32 count = 700;
+	std::vector<u8> data(count * 2048);
+	disc.ReadSectors(start, count, data.data(), 2048);
+
+	u8 expected[2048];
+	for (u32 i = 0; i < count; i++)
+	{
+		u32 fad = start + i;
+		if (fad >= 900)
+			break;	// read miss
+		fillUserData(expected, fad);
+		ASSERT_EQ(0, memcmp(expected, &data[i * 2048], sizeof(expected))) << "FAD " << fad;
+	}
+
+	// Single raw sector
+	u8 raw[2352];
+	disc.ReadSectors(200, 1, raw, 2352);
+	fillUserData(expected, 200);
+	ASSERT_EQ(1, raw[15]);
+	ASSERT_EQ(0, memcmp(expected, &raw[16], sizeof(expected)));
+}
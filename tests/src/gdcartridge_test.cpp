@@ -0,0 +1,51 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "hw/naomi/gdcartridge.h"
+
+#include <random>
+#include <vector>
+
+class TestGDCartridge : public GDCartridge
+{
+public:
+	TestGDCartridge() : GDCartridge(0) {}
+
+	// Decrypts the data one 64-bit block at a time on the calling thread
+	std::vector<u8> decryptSerial(u64 key, const std::vector<u8>& data)
+	{
+		u32 des_subkeys[32];
+		des_generate_subkeys(rev64(key), des_subkeys);
+		std::vector<u8> out(data.size());
+		for (size_t i = 0; i < data.size(); i += 8)
+			*(u64 *)&out[i] = des_encrypt_decrypt<true>(*(const u64 *)&data[i], des_subkeys);
+		return out;
+	}
+
+	std::vector<u8> decryptParallel(u64 key, const std::vector<u8>& data)
+	{
+		dimm_data = (u8 *)malloc(data.size());
+		dimm_data_size = data.size();
+		memcpy(dimm_data, data.data(), data.size());
+		EXPECT_TRUE(decrypt_dimm_data(key, data.size()));
+		std::vector<u8> out(dimm_data, dimm_data + data.size());
+		free(dimm_data);
+		dimm_data = nullptr;
+		return out;
+	}
+};
+
+TEST(GDCartridgeTest, ParallelDecrypt)
+{
+	// Several 256 KB chunks and a partial one
+	std::vector<u8> data(3 * 256 * 1024 + 2048);
+	std::mt19937 random(42);
+	for (u8& b : data)
+		b = (u8)random();
+	TestGDCartridge cart;
+	for (u64 key : { 0x0123456789abcdefull, 0xfedcba9876543210ull })
+	{
+		std::vector<u8> serial = cart.decryptSerial(key, data);
+		ASSERT_NE(data, serial);
+		ASSERT_EQ(serial, cart.decryptParallel(key, data));
+	}
+}
@@ -0,0 +1,132 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "imgread/hunkcache.h"
+
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr u32 HunkBytes = 64;
+constexpr u32 TotalHunks = 100;
+
+// Fills each hunk with its number and records the hunks read
+class FakeChd
+{
+public:
+	HunkCache::ReadHunk reader()
+	{
+		return [this](u32 hunk, u8 *dst) {
+			memset(dst, (u8)hunk, HunkBytes);
+			std::lock_guard<std::mutex> lock(mutex);
+			hunks.push_back(hunk);
+			return true;
+		};
+	}
+
+	std::vector<u32> reads()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return hunks;
+	}
+
+	// Waits until the read-ahead thread has decompressed the given number of hunks
+	void waitForReads(size_t count)
+	{
+		for (int i = 0; i < 1000 && reads().size() < count; i++)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		ASSERT_EQ(count, reads().size());
+	}
+
+private:
+	std::mutex mutex;
+	std::vector<u32> hunks;
+};
+
+void readHunk(HunkCache& cache, u32 hunk)
+{
+	u8 data[HunkBytes / 2];
+	ASSERT_TRUE(cache.read(hunk, HunkBytes / 2, data, sizeof(data)));
+	for (u8 b : data)
+		ASSERT_EQ((u8)hunk, b);
+}
+
+}
+
+TEST(HunkCacheTest, LruEviction)
+{
+	// Two entries: no read-ahead
+	FakeChd chd;
+	HunkCache cache(chd.reader(), HunkBytes, TotalHunks, 2);
+	readHunk(cache, 1);
+	readHunk(cache, 2);
+	readHunk(cache, 1);
+	// 2 is the least recently used
+	readHunk(cache, 3);
+	readHunk(cache, 1);
+	readHunk(cache, 2);
+	ASSERT_EQ(std::vector<u32>({ 1, 2, 3, 2 }), chd.reads());
+	const HunkCache::Stats& stats = cache.getStats();
+	ASSERT_EQ(2u, stats.hits);
+	ASSERT_EQ(4u, stats.misses);
+	ASSERT_EQ(4u, stats.decompressed);
+	ASSERT_EQ(0u, stats.readAheadHits);
+}
+
+TEST(HunkCacheTest, AlternatingHunks)
+{
+	FakeChd chd;
+	HunkCache cache(chd.reader(), HunkBytes, TotalHunks, 2);
+	for (int i = 0; i < 5; i++)
+	{
+		readHunk(cache, 5);
+		readHunk(cache, 6);
+	}
+	ASSERT_EQ(std::vector<u32>({ 5, 6 }), chd.reads());
+	const HunkCache::Stats& stats = cache.getStats();
+	ASSERT_EQ(8u, stats.hits);
+	ASSERT_EQ(2u, stats.misses);
+	ASSERT_EQ(2u, stats.decompressed);
+}
+
+TEST(HunkCacheTest, ReadAheadForward)
+{
+	FakeChd chd;
+	HunkCache cache(chd.reader(), HunkBytes, TotalHunks, 8);
+	readHunk(cache, 10);
+	// The next two hunks are decompressed in the background
+	chd.waitForReads(3);
+	ASSERT_EQ(std::vector<u32>({ 10, 11, 12 }), chd.reads());
+	readHunk(cache, 11);
+	chd.waitForReads(4);
+	readHunk(cache, 12);
+	chd.waitForReads(5);
+	ASSERT_EQ(std::vector<u32>({ 10, 11, 12, 13, 14 }), chd.reads());
+	const HunkCache::Stats& stats = cache.getStats();
+	ASSERT_EQ(2u, stats.hits);
+	ASSERT_EQ(1u, stats.misses);
+	ASSERT_EQ(2u, stats.readAheadHits);
+	ASSERT_EQ(5u, stats.decompressed);
+}
+
+TEST(HunkCacheTest, ReadAheadBackward)
+{
+	FakeChd chd;
+	HunkCache cache(chd.reader(), HunkBytes, TotalHunks, 8);
+	readHunk(cache, 50);
+	chd.waitForReads(3);
+	// Reading the previous hunk reverses the direction
+	readHunk(cache, 49);
+	chd.waitForReads(6);
+	ASSERT_EQ(std::vector<u32>({ 50, 51, 52, 49, 48, 47 }), chd.reads());
+	readHunk(cache, 48);
+	chd.waitForReads(7);
+	ASSERT_EQ(46u, chd.reads().back());
+	const HunkCache::Stats& stats = cache.getStats();
+	ASSERT_EQ(1u, stats.hits);
+	ASSERT_EQ(2u, stats.misses);
+	ASSERT_EQ(1u, stats.readAheadHits);
+	ASSERT_EQ(7u, stats.decompressed);
+}
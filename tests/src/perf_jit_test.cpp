@@ -0,0 +1,63 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "cfg/option.h"
+#include "profiler/perf_jit.h"
+
+#if defined(__linux__) && !defined(__ANDROID__)
+#include <unistd.h>
+#include <cinttypes>
+#include <fstream>
+#include <sstream>
+
+class PerfJitTest : public ::testing::Test {
+protected:
+	static std::string readFile(const std::string& path)
+	{
+		std::ifstream f(path, std::ios::binary);
+		std::stringstream ss;
+		ss << f.rdbuf();
+		return ss.str();
+	}
+};
+
+TEST_F(PerfJitTest, CodeLoaded)
+{
+	const u8 code[] = { 0x90, 0x90, 0xc3 };
+	perfjit::codeLoaded(code, sizeof(code), "disabled");
+	config::DynarecPerfMap.set(true);
+	perfjit::codeLoaded(code, sizeof(code), "sh4:8C010000,c:3,h:12345678");
+	perfjit::term();
+	config::DynarecPerfMap.reset();
+
+	std::string mapPath = "/tmp/perf-" + std::to_string(getpid()) + ".map";
+	std::string map = readFile(mapPath);
+	std::string dumpPath = "/tmp/jit-" + std::to_string(getpid()) + ".dump";
+	std::string dump = readFile(dumpPath);
+	// Removed before checking them so that failures don't leave them behind
+	unlink(mapPath.c_str());
+	unlink(dumpPath.c_str());
+
+	char line[128];
+	sprintf(line, "%" PRIxPTR " 3 sh4:8C010000,c:3,h:12345678\n", (uintptr_t)code);
+	ASSERT_EQ(std::string(line), map);
+
+	// header, code load record, close record
+	const u32 headerSize = 40;
+	const u32 loadSize = 56 + 28 + sizeof(code);
+	ASSERT_EQ(headerSize + loadSize + 16, dump.size());
+	u32 v;
+	memcpy(&v, &dump[0], 4);
+	ASSERT_EQ(0x4A695444u, v);
+	memcpy(&v, &dump[headerSize], 4);
+	ASSERT_EQ(0u, v);		// JIT_CODE_LOAD
+	memcpy(&v, &dump[headerSize + 4], 4);
+	ASSERT_EQ(loadSize, v);
+	u64 addr;
+	memcpy(&addr, &dump[headerSize + 32], 8);
+	ASSERT_EQ((u64)(uintptr_t)code, addr);
+	ASSERT_STREQ("sh4:8C010000,c:3,h:12345678", &dump[headerSize + 56]);
+	ASSERT_EQ(0, memcmp(code, &dump[headerSize + 56 + 28], sizeof(code)));
+	memcpy(&v, &dump[headerSize + loadSize], 4);
+	ASSERT_EQ(3u, v);		// JIT_CODE_CLOSE
+}
+#endif
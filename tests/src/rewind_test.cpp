@@ -0,0 +1,57 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "hw/mem/_vmem.h"
+#include "hw/sh4/sh4_mem.h"
+#include "emulator.h"
+#include "cfg/option.h"
+#include "rewind.h"
+
+bool dc_serialize(void **data, unsigned int *total_size);
+
+class RewindTest : public ::testing::Test {
+protected:
+	void SetUp() override {
+		if (!_vmem_reserve())
+			die("_vmem_reserve failed");
+		dc_init();
+		dc_reset(true);
+	}
+
+	std::vector<u8> serialize()
+	{
+		unsigned int size = 0;
+		void *data = nullptr;
+		dc_serialize(&data, &size);
+		std::vector<u8> state(size);
+		data = state.data();
+		dc_serialize(&data, &size);
+		return state;
+	}
+};
+
+TEST_F(RewindTest, RestoreTest)
+{
+	config::RewindDepth.set(2);
+	rewinder::reset();
+	ASSERT_FALSE(rewinder::available());
+
+	std::vector<std::vector<u8>> states;
+	for (int i = 0; i < 3; i++)
+	{
+		for (u32 addr = 0; addr < 0x10000; addr += 0x1000)
+			mem_b[addr + i * 4] = 0x55 + i;
+		states.push_back(serialize());
+		rewinder::capture();
+	}
+	ASSERT_TRUE(rewinder::available());
+
+	// Only the last two snapshots are kept
+	std::vector<u8> state;
+	ASSERT_TRUE(rewinder::pop(state));
+	ASSERT_TRUE(states[2] == state);
+	ASSERT_TRUE(rewinder::pop(state));
+	ASSERT_TRUE(states[1] == state);
+	ASSERT_FALSE(rewinder::pop(state));
+	ASSERT_FALSE(rewinder::available());
+	config::RewindDepth.reset();
+}
@@ -0,0 +1,56 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "archive/rzip.h"
+
+#include <random>
+
+class RZipTest : public ::testing::Test {
+protected:
+	void SetUp() override
+	{
+		// Compressible data with some random runs
+		std::mt19937 rng(42);
+		data.resize(5 * 1024 * 1024 + 12345);
+		for (size_t i = 0; i < data.size(); i++)
+			data[i] = (i & 0x100) ? (u8)rng() : (u8)(i >> 12);
+	}
+	void TearDown() override
+	{
+		std::remove(path.c_str());
+	}
+
+	std::vector<u8> data;
+	const std::string path = "rzip_test.bin";
+};
+
+TEST_F(RZipTest, ReadWrite)
+{
+	RZipFile writer;
+	ASSERT_TRUE(writer.Open(path, true));
+	ASSERT_EQ(data.size(), writer.Write(data.data(), data.size()));
+	writer.Close();
+
+	// Read in one go
+	RZipFile reader;
+	ASSERT_TRUE(reader.Open(path, false));
+	ASSERT_EQ(data.size(), reader.Size());
+	std::vector<u8> out(data.size());
+	ASSERT_EQ(data.size(), reader.Read(out.data(), out.size()));
+	ASSERT_TRUE(data == out);
+	u8 b;
+	ASSERT_EQ(0u, reader.Read(&b, 1));
+	reader.Close();
+
+	// Read in pieces of various sizes
+	ASSERT_TRUE(reader.Open(path, false));
+	std::fill(out.begin(), out.end(), 0);
+	size_t pieces[] = { 1000, 3 * 1024 * 1024, 1, 1024 * 1024 + 1, 5000 };
+	size_t offset = 0;
+	for (size_t i = 0; offset < out.size(); i++)
+	{
+		size_t l = std::min(pieces[i % ARRAY_SIZE(pieces)], out.size() - offset);
+		ASSERT_EQ(l, reader.Read(&out[offset], l));
+		offset += l;
+	}
+	ASSERT_TRUE(data == out);
+}
@@ -0,0 +1,69 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "hw/aica/sgc_mix.h"
+
+#include <random>
+
+class SgcMixTest : public ::testing::Test {
+protected:
+	void randomBatch(ChannelBatch& batch)
+	{
+		for (u32 i = 0; i < MIX_BATCH_SIZE; i++)
+		{
+			batch.s0[i] = (s32)(rng() % 65536) - 32768;
+			batch.s1[i] = (s32)(rng() % 65536) - 32768;
+			batch.fp[i] = rng() % 1024;
+			// some muted samples to exercise the dsp send fallback
+			batch.gainLeft[i] = rng() % 4 == 0 ? 0 : rng() % 32769;
+			batch.gainRight[i] = rng() % 4 == 0 ? 0 : rng() % 32769;
+			batch.gainDsp[i] = rng() % 32769;
+		}
+	}
+
+	std::mt19937 rng{ 42 };
+};
+
+TEST_F(SgcMixTest, BitExact)
+{
+	alignas(16) s32 mixl[2][MIX_BATCH_SIZE] {};
+	alignas(16) s32 mixr[2][MIX_BATCH_SIZE] {};
+	alignas(16) s32 mixs[2][MIX_BATCH_SIZE] {};
+	ChannelBatch batch;
+	for (int n = 0; n < 1000; n++)
+	{
+		randomBatch(batch);
+		if (n == 0)
+		{
+			// extremes
+			for (u32 i = 0; i < MIX_BATCH_SIZE; i++)
+			{
+				batch.s0[i] = i & 1 ? 32767 : -32768;
+				batch.s1[i] = i & 2 ? 32767 : -32768;
+				batch.gainLeft[i] = batch.gainRight[i] = batch.gainDsp[i] = 32768;
+			}
+		}
+		if (n & 1)
+		{
+			mixBatchScalar<true>(batch, mixl[0], mixr[0], mixs[0]);
+			mixBatch<true>(batch, mixl[1], mixr[1], mixs[1]);
+		}
+		else
+		{
+			mixBatchScalar<false>(batch, mixl[0], mixr[0], nullptr);
+			mixBatch<false>(batch, mixl[1], mixr[1], nullptr);
+		}
+		for (u32 i = 0; i < MIX_BATCH_SIZE; i++)
+		{
+			ASSERT_EQ(mixl[0][i], mixl[1][i]) << "batch " << n << " sample " << i;
+			ASSERT_EQ(mixr[0][i], mixr[1][i]) << "batch " << n << " sample " << i;
+			ASSERT_EQ(mixs[0][i], mixs[1][i]) << "batch " << n << " sample " << i;
+		}
+		// keep the accumulators in range
+		if (n % 64 == 63)
+		{
+			memset(mixl, 0, sizeof(mixl));
+			memset(mixr, 0, sizeof(mixr));
+			memset(mixs, 0, sizeof(mixs));
+		}
+	}
+}
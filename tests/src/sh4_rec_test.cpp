@@ -0,0 +1,639 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "hw/sh4/sh4_if.h"
+#include "hw/sh4/sh4_core.h"
+#include "hw/sh4/sh4_sched.h"
+#include "hw/sh4/sh4_mem.h"
+#include "hw/sh4/modules/mmu.h"
+#include "hw/mem/_vmem.h"
+#include "hw/sh4/dyna/ngen.h"
+#include "hw/sh4/dyna/blockoptimizer.h"
+#include "hw/sh4/dyna/blockcache.h"
+#include "emulator.h"
+#include "cfg/option.h"
+#include "profiler/profiler.h"
+#include "stdclass.h"
+
+#include <cmath>
+#include <iterator>
+#include <vector>
+
+#if FEAT_SHREC != DYNAREC_NONE
+void Get_Sh4Recompiler(sh4_if* cpu);
+#endif
+void Get_Sh4Interpreter(sh4_if* cpu);
+void install_fault_handler();
+
+namespace {
+
+constexpr u32 CodeAddress = 0x8c010000;
+
+// Exercises conditional, dynamic and static block ends
+const u16 Program[] = {
+	0xE000,		// mov #0, r0
+	0xE201,		// mov #1, r2
+	0x4228,		// shll16 r2
+	0xD306,		// mov.l @(0x20), r3
+// loop:
+	0x7001,		// add #1, r0
+	0x4210,		// dt r2
+	0x8BFC,		// bf loop
+	0x432B,		// jmp @r3
+	0x0009,		// nop
+// 0x12:
+	0x7164,		// add #100, r1
+	0xA000,		// bra 0x18
+	0x0009,		// nop
+// 0x18:
+	0x7402,		// add #2, r4
+	0xAFFE,		// bra 0x1a
+	0x0009,		// nop
+	0x0009,		// nop
+// 0x20:
+	(u16)(CodeAddress + 0x12), (u16)((CodeAddress + 0x12) >> 16),
+};
+
+// A chain of blocks too large for the code cache, run three times
+constexpr u32 ChainLength = 20000;
+constexpr u32 BlockAdds = 64;
+
+std::vector<u16> makeChain()
+{
+	std::vector<u16> program;
+	for (u32 i = 0; i < ChainLength; i++)
+	{
+		for (u32 j = 0; j < BlockAdds; j++)
+			program.push_back(0x7201);	// add #1, r2
+		program.push_back(0xA000);	// bra next
+		program.push_back(0x0009);	// nop
+	}
+	const u16 end[] = {
+		0xE003,		// mov #3, r0
+		0x7101,		// add #1, r1
+		0x3100,		// cmp/eq r0, r1
+		0x8902,		// bt done
+		0xD302,		// mov.l @(start), r3
+		0x432B,		// jmp @r3
+		0x0009,		// nop
+	// done:
+		0xAFFE,		// bra done
+		0x0009,		// nop
+		0x0009,		// nop
+	// start:
+		(u16)CodeAddress, (u16)(CodeAddress >> 16),
+	};
+	program.insert(program.end(), std::begin(end), std::end(end));
+	return program;
+}
+
+// A loop calling a leaf function and jumping over some code
+constexpr u32 CallLoopAddress = CodeAddress + 6;
+const u16 CallLoop[] = {
+	0xE000,		// mov #0, r0
+	0xE201,		// mov #1, r2
+	0x4228,		// shll16 r2
+// loop:
+	0xB007,		// bsr func
+	0x7001,		// add #1, r0
+	0xA001,		// bra next
+	0x7402,		// add #2, r4
+	0x7564,		// add #100, r5
+// next:
+	0x4210,		// dt r2
+	0x8BF8,		// bf loop
+// done:
+	0xAFFE,		// bra done
+	0x0009,		// nop
+// func:
+	0x7103,		// add #3, r1
+	0x000B,		// rts
+	0x0009,		// nop
+};
+
+// A loop calling a function from two places
+const u16 CallReturn[] = {
+	0xE000,		// mov #0, r0
+	0xE201,		// mov #1, r2
+	0x4228,		// shll16 r2
+	0xD306,		// mov.l @(func), r3
+// loop:
+	0x430B,		// jsr @r3
+	0x7001,		// add #1, r0
+	0x430B,		// jsr @r3
+	0x7402,		// add #2, r4
+	0x4210,		// dt r2
+	0x8BF9,		// bf loop
+// done:
+	0xAFFE,		// bra done
+	0x0009,		// nop
+// 0x18:
+	0x7103,		// add #3, r1
+	0x000B,		// rts
+	0x0009,		// nop
+	0x0009,		// nop
+// func:
+	(u16)(CodeAddress + 0x18), (u16)((CodeAddress + 0x18) >> 16),
+};
+
+// Transforms vectors with ftrv and fipr in a loop
+constexpr u32 TransformLoops = 0x10000;
+const u16 Transform[] = {
+	0xE201,		// mov #1, r2
+	0x4228,		// shll16 r2
+// loop:
+	0xF1FD,		// ftrv xmtrx, fv0
+	0xF40C,		// fmov fr0, fr4
+	0xF51C,		// fmov fr1, fr5
+	0xF62C,		// fmov fr2, fr6
+	0xF73C,		// fmov fr3, fr7
+	0xF90C,		// fmov fr0, fr9
+	0xFA1C,		// fmov fr1, fr10
+	0xFB2C,		// fmov fr2, fr11
+	0xF83C,		// fmov fr3, fr8
+	0xF5FD,		// ftrv xmtrx, fv4
+	0xF9FD,		// ftrv xmtrx, fv8
+	0xF5FD,		// ftrv xmtrx, fv4
+	0xF9ED,		// fipr fv4, fv8
+	0xF4ED,		// fipr fv0, fv4
+	0x4210,		// dt r2
+	0x8BEF,		// bf loop
+// done:
+	0xAFFE,		// bra done
+	0x0009,		// nop
+};
+
+// Reads and writes a virtual page mapped by the MMU while switching the ASID
+constexpr u32 MmuLoops = 0x4000;
+constexpr u32 MmuVirtAddress = 0x10000000;
+constexpr u32 MmuPhysAddress = 0x0C100000;
+const u16 MmuAccess[] = {
+	0xD30B,		// mov.l @(data), r3
+	0xE100,		// mov #0, r1
+	0x2312,		// mov.l r1, @r3
+	0x1311,		// mov.l r1, @(4, r3)
+	0xE201,		// mov #1, r2
+	0x4228,		// shll16 r2
+	0x4209,		// shlr2 r2
+	0xE6FF,		// mov #-1, r6
+	0x4628,		// shll16 r6
+	0x4618,		// shll8 r6		(PTEH)
+	0xE701,		// mov #1, r7
+// loop:
+	0x6132,		// mov.l @r3, r1
+	0x7101,		// add #1, r1
+	0x2312,		// mov.l r1, @r3
+	0x5431,		// mov.l @(4, r3), r4
+	0x7402,		// add #2, r4
+	0x1341,		// mov.l r4, @(4, r3)
+	0x257A,		// xor r7, r5
+	0x2652,		// mov.l r5, @r6	(ASID)
+	0x4210,		// dt r2
+	0x8BF5,		// bf loop
+// done:
+	0xAFFE,		// bra done
+	0x0009,		// nop
+	0x0009,		// nop
+// data:
+	(u16)MmuVirtAddress, (u16)(MmuVirtAddress >> 16),
+};
+
+int stopCallback(int tag, int cycles, int jitter)
+{
+	sh4_cpu.Stop();
+	return 0;
+}
+
+}
+
+class Sh4RecTest : public ::testing::Test {
+protected:
+	void SetUp() override {
+		// Reserving again would leave mem_b in the previous mapping, where pages may still be write-protected
+		if (virt_ram_base == nullptr && !_vmem_reserve())
+			die("_vmem_reserve failed");
+		// needed by the recompiler
+		install_fault_handler();
+		dc_init();
+		mem_map_default();
+		dc_reset(true);
+		static int schedId = sh4_sched_register(0, stopCallback);
+		this->schedId = schedId;
+	}
+
+	void load(void (*getCpu)(sh4_if *), const u16 *program, size_t size)
+	{
+		getCpu(&sh4_cpu);
+		SetMemoryHandlers();
+		memcpy(GetMemPtr(CodeAddress, size), program, size);
+		// also protects the pages written above again
+		sh4_cpu.ResetCache();
+	}
+
+	void run(int cycles, u32 pc = CodeAddress)
+	{
+		for (int i = 0; i < 16; i++)
+			r[i] = 0;
+		next_pc = pc;
+		sh4_sched_request(schedId, cycles);
+		sh4_cpu.Start();
+		sh4_cpu.Run();
+	}
+
+	void run(void (*getCpu)(sh4_if *), const u16 *program, size_t size, int cycles)
+	{
+		load(getCpu, program, size);
+		run(cycles);
+	}
+
+	int schedId;
+};
+
+#if FEAT_SHREC != DYNAREC_NONE
+TEST_F(Sh4RecTest, BlockEnds)
+{
+	for (auto getCpu : { Get_Sh4Interpreter, Get_Sh4Recompiler })
+	{
+		u64 promotions = rdv_GetCacheStats().promotions;
+		run(getCpu, Program, sizeof(Program), SH4_MAIN_CLOCK / 100);
+		ASSERT_EQ(0x10000u, r[0]);
+		ASSERT_EQ(100u, r[1]);
+		ASSERT_EQ(0u, r[2]);
+		ASSERT_EQ(CodeAddress + 0x12, r[3]);
+		ASSERT_EQ(2u, r[4]);
+		if (getCpu == Get_Sh4Recompiler)
+		{
+			// the loop and the final block are hot and get optimized in the background
+			blockoptimizer::wait();
+			sh4_sched_request(schedId, SH4_MAIN_CLOCK / 100);
+			sh4_cpu.Start();
+			sh4_cpu.Run();
+			ASSERT_LT(promotions, rdv_GetCacheStats().promotions);
+			ASSERT_EQ(0x10000u, r[0]);
+			ASSERT_EQ(2u, r[4]);
+		}
+	}
+}
+#endif
+
+#if FEAT_SHREC != DYNAREC_NONE
+TEST_F(Sh4RecTest, CodeCacheEviction)
+{
+	std::vector<u16> program = makeChain();
+	for (auto getCpu : { Get_Sh4Interpreter, Get_Sh4Recompiler })
+	{
+		DynarecCacheStats before = rdv_GetCacheStats();
+		run(getCpu, program.data(), program.size() * 2, SH4_MAIN_CLOCK / 4);
+		ASSERT_EQ(3u, r[1]);
+		ASSERT_EQ(3 * ChainLength * BlockAdds, r[2]);
+		if (getCpu == Get_Sh4Recompiler)
+		{
+			const DynarecCacheStats& stats = rdv_GetCacheStats();
+			ASSERT_LT(before.evictions, stats.evictions);
+			ASSERT_LT(before.evictedBlocks, stats.evictedBlocks);
+			ASSERT_LT(before.recompiles, stats.recompiles);
+			ASSERT_EQ(before.flushes + 1, stats.flushes);
+		}
+	}
+}
+#endif
+
+#if FEAT_SHREC != DYNAREC_NONE
+TEST_F(Sh4RecTest, RunningFlush)
+{
+	// Compiling a block at this address flushes the code cache while the cpu is running
+	constexpr u32 FlushAddress = 0x8c0000e0;
+	const u16 jumpToChain[] = {
+		0xD301,		// mov.l @(start), r3
+		0x432B,		// jmp @r3
+		0x0009,		// nop
+		0x0009,		// nop
+	// start:
+		(u16)CodeAddress, (u16)(CodeAddress >> 16),
+	};
+	std::vector<u16> program = makeChain();
+	Get_Sh4Recompiler(&sh4_cpu);
+	SetMemoryHandlers();
+	memcpy(GetMemPtr(FlushAddress, sizeof(jumpToChain)), jumpToChain, sizeof(jumpToChain));
+	load(Get_Sh4Recompiler, program.data(), program.size() * 2);
+	DynarecCacheStats before = rdv_GetCacheStats();
+	// The chain then evicts every region of the code cache, which must not hold the code emitted by the flush
+	run(SH4_MAIN_CLOCK / 4, FlushAddress);
+	ASSERT_EQ(3u, r[1]);
+	ASSERT_EQ(3 * ChainLength * BlockAdds, r[2]);
+	const DynarecCacheStats& stats = rdv_GetCacheStats();
+	ASSERT_EQ(before.flushes + 1, stats.flushes);
+	// the code cache has 8 regions
+	ASSERT_LE(before.evictions + 8, stats.evictions);
+}
+#endif
+
+#if FEAT_SHREC == DYNAREC_JIT && HOST_CPU == CPU_X64
+TEST_F(Sh4RecTest, AsyncCompile)
+{
+	config::DynarecAsyncCompile.set(true);
+	DynarecCacheStats before = rdv_GetCacheStats();
+	run(Get_Sh4Recompiler, Program, sizeof(Program), SH4_MAIN_CLOCK / 100);
+	ASSERT_EQ(0x10000u, r[0]);
+	ASSERT_EQ(100u, r[1]);
+	ASSERT_EQ(CodeAddress + 0x12, r[3]);
+	ASSERT_EQ(2u, r[4]);
+	const DynarecCacheStats& stats = rdv_GetCacheStats();
+	// the blocks are interpreted until they're decoded
+	ASSERT_LT(before.interpreted, stats.interpreted);
+	ASSERT_LT(before.asyncCompiles, stats.asyncCompiles);
+	config::DynarecAsyncCompile.reset();
+}
+
+TEST_F(Sh4RecTest, AsyncCompileModifiedCode)
+{
+	const u16 program[] = {
+		0xE105,		// mov #5, r1
+		0xA000,		// bra done
+		0x0009,		// nop
+	// done:
+		0xAFFE,		// bra done
+		0x0009,		// nop
+	};
+	config::DynarecAsyncCompile.set(true);
+	run(Get_Sh4Recompiler, program, sizeof(program), SH4_MAIN_CLOCK / 1000);
+	ASSERT_EQ(5u, r[1]);
+	// The first block has been interpreted once and is decoded but not compiled
+	blockoptimizer::wait();
+	WriteMem16(CodeAddress, 0xE107);	// mov #7, r1
+	run(SH4_MAIN_CLOCK / 1000);
+	ASSERT_EQ(7u, r[1]);
+	config::DynarecAsyncCompile.reset();
+}
+#endif
+
+#if FEAT_SHREC != DYNAREC_NONE
+TEST_F(Sh4RecTest, Superblocks)
+{
+	for (bool superblocks : { false, true })
+	{
+		config::DynarecSuperblocks.set(superblocks);
+		load(Get_Sh4Recompiler, CallLoop, sizeof(CallLoop));
+		// Compile and optimize the blocks first
+		run(SH4_MAIN_CLOCK / 100);
+		blockoptimizer::wait();
+		u64 compiles = rdv_GetCacheStats().compiles;
+		run(SH4_MAIN_CLOCK / 100);
+		// Everything is compiled already
+		ASSERT_EQ(compiles, rdv_GetCacheStats().compiles);
+		ASSERT_EQ(0x10000u, r[0]);
+		ASSERT_EQ(3 * 0x10000u, r[1]);
+		ASSERT_EQ(0u, r[2]);
+		ASSERT_EQ(2 * 0x10000u, r[4]);
+		ASSERT_EQ(0u, r[5]);
+		ASSERT_EQ(CallLoopAddress + 4, pr);
+
+		RuntimeBlockInfoPtr block = bm_GetBlock(CallLoopAddress);
+		ASSERT_TRUE(block->optimized);
+		if (superblocks)
+		{
+			// The call, the return and the jump are followed
+			ASSERT_EQ(9u, block->guest_opcodes);
+			ASSERT_EQ(sizeof(CallLoop) - 6, block->sh4_code_size);
+			ASSERT_EQ(BET_Cond_0, block->BlockType);
+		}
+		else
+		{
+			ASSERT_EQ(2u, block->guest_opcodes);
+			ASSERT_EQ(BET_StaticCall, block->BlockType);
+		}
+	}
+	config::DynarecSuperblocks.reset();
+}
+#endif
+
+#if FEAT_SHREC != DYNAREC_NONE
+TEST_F(Sh4RecTest, BlockCache)
+{
+	config::DynarecBlockCache.set(true);
+	config::Settings::instance().setGameId("BLOCKCACHE-TEST");
+	const std::string path = get_writable_data_path("BLOCKCACHE_TEST.bcache");
+	nowide::remove(path.c_str());
+	auto checkResults = [](u32 increment) {
+		ASSERT_EQ(increment * 0x10000u, r[0]);
+		ASSERT_EQ(100u, r[1]);
+		ASSERT_EQ(2u, r[4]);
+	};
+
+	// Decode and optimize the hot blocks, and save them
+	EventManager::event(Event::Start);
+	load(Get_Sh4Recompiler, Program, sizeof(Program));
+	run(SH4_MAIN_CLOCK / 100);
+	blockoptimizer::wait();
+	run(SH4_MAIN_CLOCK / 100);
+	checkResults(1);
+	ASSERT_LT(0u, blockcache::getStats().stored);
+	EventManager::event(Event::Terminate);
+	ASSERT_TRUE(file_exists(path));
+
+	// The optimized blocks are loaded from the file
+	EventManager::event(Event::Start);
+	load(Get_Sh4Recompiler, Program, sizeof(Program));
+	run(SH4_MAIN_CLOCK / 100);
+	checkResults(1);
+	blockcache::Stats stats = blockcache::getStats();
+	ASSERT_LT(0u, stats.hits);
+	ASSERT_LT(0u, stats.misses);	// cold blocks aren't cached
+	ASSERT_EQ(0u, stats.rejected);
+
+	// The guest code has been modified
+	EventManager::event(Event::Start);
+	std::vector<u16> modified(std::begin(Program), std::end(Program));
+	modified[4] = 0x7002;	// add #2, r0
+	load(Get_Sh4Recompiler, modified.data(), modified.size() * 2);
+	run(SH4_MAIN_CLOCK / 100);
+	checkResults(2);
+	stats = blockcache::getStats();
+	ASSERT_EQ(0u, stats.hits);
+	ASSERT_LT(0u, stats.rejected);
+
+	// Another fpscr mode has other entries
+	EventManager::event(Event::Start);
+	load(Get_Sh4Recompiler, Program, sizeof(Program));
+	const fpscr_t savedFpscr = fpscr;
+	for (int mode = 0; mode < 3; mode++)
+	{
+		fpscr = savedFpscr;
+		if (mode == 0)
+			fpscr.RM ^= 1;
+		else if (mode == 1)
+			fpscr.PR ^= 1;
+		else
+			fpscr.SZ ^= 1;
+		sh4_cpu.ResetCache();
+		run(SH4_MAIN_CLOCK / 100);
+		checkResults(1);
+		ASSERT_EQ(0u, blockcache::getStats().hits);
+	}
+	fpscr = savedFpscr;
+
+	// The page of the blocks has been written to since they've been saved
+	EventManager::event(Event::Start);
+	load(Get_Sh4Recompiler, Program, sizeof(Program));
+	run(SH4_MAIN_CLOCK / 100);
+	u32 hits = blockcache::getStats().hits;
+	ASSERT_LT(0u, hits);
+	// What the fault handler does when the page is written to. The guest code is the same, only the protection differs.
+	bm_RamWriteAccess(CodeAddress + 0x800);
+	run(SH4_MAIN_CLOCK / 100);
+	checkResults(1);
+	stats = blockcache::getStats();
+	ASSERT_EQ(hits, stats.hits);
+	ASSERT_LT(0u, stats.rejected);
+
+	EventManager::event(Event::Terminate);
+	nowide::remove(path.c_str());
+	config::Settings::instance().setGameId("");
+	config::DynarecBlockCache.reset();
+}
+#endif
+
+#if FEAT_SHREC == DYNAREC_JIT && HOST_CPU == CPU_X64
+TEST_F(Sh4RecTest, ReturnStack)
+{
+	// Calls and returns must stay in separate blocks
+	config::DynarecSuperblocks.set(false);
+	load(Get_Sh4Recompiler, CallReturn, sizeof(CallReturn));
+	const u32 top = bm_ReturnStackTop;
+	u32 hits = prof.counters.bm.callstack_hit;
+	u32 misses = prof.counters.bm.callstack_miss;
+	// Short slices so that many returns go back to the main loop
+	run(SH4_MAIN_CLOCK / 1000);
+	while (r[2] != 0)
+	{
+		sh4_sched_request(schedId, SH4_MAIN_CLOCK / 1000);
+		sh4_cpu.Start();
+		sh4_cpu.Run();
+	}
+	config::DynarecSuperblocks.reset();
+	ASSERT_EQ(0x10000u, r[0]);
+	ASSERT_EQ(6 * 0x10000u, r[1]);
+	ASSERT_EQ(2 * 0x10000u, r[4]);
+	hits = prof.counters.bm.callstack_hit - hits;
+	misses = prof.counters.bm.callstack_miss - misses;
+	// Every return pops the stack, whether it's linked or goes back to the main loop
+	ASSERT_EQ(2 * 0x10000u, hits + misses);
+	ASSERT_EQ(top, bm_ReturnStackTop);
+	// Only the returns following a change of the block map aren't predicted.
+	// Hot blocks replaced by the optimizer thread may add a few.
+	ASSERT_LT(0u, misses);
+	ASSERT_GT(16u, misses);
+}
+#endif
+
+#if FEAT_SHREC != DYNAREC_NONE
+TEST_F(Sh4RecTest, VectorOps)
+{
+	float result[16];
+	for (auto getCpu : { Get_Sh4Interpreter, Get_Sh4Recompiler })
+	{
+		// xmtrx is a rotation of angle 0.1 in the (x, y) and (z, w) planes
+		const float c = std::cos(0.1f);
+		const float s = std::sin(0.1f);
+		const float matrix[16] = {
+			c, s, 0, 0,
+			-s, c, 0, 0,
+			0, 0, c, s,
+			0, 0, -s, c,
+		};
+		memcpy(xf, matrix, sizeof(matrix));
+		for (int i = 0; i < 16; i++)
+			fr[i] = 0.5f;
+		load(getCpu, Transform, sizeof(Transform));
+		// Compile and optimize the blocks first
+		if (getCpu == Get_Sh4Recompiler)
+		{
+			run(SH4_MAIN_CLOCK / 100);
+			blockoptimizer::wait();
+			for (int i = 0; i < 16; i++)
+				fr[i] = 0.5f;
+		}
+		run(SH4_MAIN_CLOCK / 1000);
+		while (r[2] != 0)
+		{
+			sh4_sched_request(schedId, SH4_MAIN_CLOCK / 1000);
+			sh4_cpu.Start();
+			sh4_cpu.Run();
+		}
+		ASSERT_EQ(0u, r[2]);
+		ASSERT_EQ(0, memcmp(xf, matrix, sizeof(matrix)));
+		if (getCpu == Get_Sh4Interpreter)
+		{
+			memcpy(result, fr, sizeof(result));
+			// The vectors have been transformed
+			ASSERT_NE(0.5f, result[0]);
+		}
+		else
+		{
+			for (int i = 0; i < 16; i++)
+			{
+#if HOST_CPU == CPU_X64
+				// same precision and order of operations as the interpreter
+				ASSERT_EQ(0, memcmp(&result[i], &fr[i], sizeof(float))) << "fr" << i;
+#else
+				ASSERT_NEAR(result[i], fr[i], 1e-3f) << "fr" << i;
+#endif
+			}
+		}
+	}
+}
+#endif
+
+#if FEAT_SHREC == DYNAREC_JIT && HOST_CPU == CPU_X64 && defined(FAST_MMU)
+TEST_F(Sh4RecTest, MmuTlb)
+{
+	auto enableMmu = [](bool enable) {
+		config::FullMMU.set(enable);
+		CCN_MMUCR.AT = enable;
+		mmu_set_state();
+	};
+	for (int mode = 0; mode < 3; mode++)
+	{
+		config::DynarecMmuTlb.set(mode == 0);
+		config::DisableVmem32.set(mode == 2);
+		enableMmu(true);
+		// shared 4 KB page
+		TLB_Entry& entry = UTLB[0];
+		entry.Address.reg_data = MmuVirtAddress;
+		entry.Data.reg_data = 0;
+		entry.Data.PPN = MmuPhysAddress >> 10;
+		entry.Data.SZ0 = 1;
+		entry.Data.PR = 3;
+		entry.Data.D = 1;
+		entry.Data.SH = 1;
+		entry.Data.V = 1;
+		UTLB_Sync(0);
+
+		load(Get_Sh4Recompiler, MmuAccess, sizeof(MmuAccess));
+		run(SH4_MAIN_CLOCK / 1000);
+		while (r[2] != 0)
+		{
+			sh4_sched_request(schedId, SH4_MAIN_CLOCK / 1000);
+			sh4_cpu.Start();
+			sh4_cpu.Run();
+		}
+		ASSERT_EQ(MmuLoops, r[1]);
+		ASSERT_EQ(2 * MmuLoops, r[4]);
+		if (mode == 0)
+		{
+			ASSERT_EQ(MmuVirtAddress, mmuTlb[mmu_tlb_index(MmuVirtAddress, 0)].tag);
+			ASSERT_EQ(MmuVirtAddress | 1, mmuTlb[mmu_tlb_index(MmuVirtAddress, 1)].tag);
+			// Updating the UTLB entry invalidates the page for all ASIDs
+			UTLB_Sync(0);
+			ASSERT_EQ(MMU_TLB_INVALID, mmuTlb[mmu_tlb_index(MmuVirtAddress, 0)].tag);
+			ASSERT_EQ(MMU_TLB_INVALID, mmuTlb[mmu_tlb_index(MmuVirtAddress, 1)].tag);
+		}
+		// The writes reached the physical page
+		ASSERT_EQ(MmuLoops, ReadMem32_nommu(MmuPhysAddress));
+		ASSERT_EQ(2 * MmuLoops, ReadMem32_nommu(MmuPhysAddress + 4));
+		enableMmu(false);
+	}
+	config::FullMMU.reset();
+	config::DynarecMmuTlb.reset();
+	config::DisableVmem32.reset();
+}
+#endif
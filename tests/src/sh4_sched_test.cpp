@@ -0,0 +1,154 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "hw/sh4/sh4_sched.h"
+#include "hw/sh4/sh4_if.h"
+#include "hw/sh4/sh4_interpreter.h"
+#include "hw/mem/_vmem.h"
+#include "emulator.h"
+
+#include <random>
+
+extern std::vector<sched_list> sch_list;
+
+namespace {
+
+// Events rescheduling themselves and each other at random intervals.
+// Each dispatch is checked against the time the event was due.
+class Workload
+{
+public:
+	Workload(int eventCount)
+	{
+		instance = this;
+		// Disable the events of the emulator, if any
+		savedEvents = sch_list;
+		savedTime = sh4_sched_now();
+		for (size_t i = 0; i < sch_list.size(); i++)
+			sh4_sched_request(i, -1);
+		for (int i = 0; i < eventCount; i++)
+		{
+			ids.push_back(sh4_sched_register(i, callback));
+			events.push_back({});
+		}
+		for (int i = 0; i < eventCount; i++)
+			request(i, rng() % 2000);
+	}
+
+	~Workload()
+	{
+		u32 elapsed = sh4_sched_now() - savedTime;
+		for (size_t i = 0; i < savedEvents.size(); i++)
+		{
+			sch_list[i] = savedEvents[i];
+			sch_list[i].start += elapsed;
+			if (sch_list[i].end != -1)
+				sch_list[i].end += elapsed;
+		}
+		for (size_t i = savedEvents.size(); i < sch_list.size(); i++)
+			sch_list[i].end = -1;
+		sh4_sched_ffts();
+	}
+
+	void run(int cycles)
+	{
+		for (int i = 0; i < cycles; i += SH4_TIMESLICE)
+		{
+			Sh4cntx.sh4_sched_next -= SH4_TIMESLICE;
+			if (Sh4cntx.sh4_sched_next < 0)
+				sh4_sched_tick(SH4_TIMESLICE);
+		}
+	}
+
+	// Returns the number of events that are overdue
+	int overdue() const
+	{
+		int count = 0;
+		for (const Event& event : events)
+			if (event.scheduled && (int)(event.due - sh4_sched_now()) < 0)
+				count++;
+		return count;
+	}
+
+	size_t dispatchCount = 0;
+
+private:
+	struct Event
+	{
+		bool scheduled;
+		int cycles;
+		u32 due;
+	};
+
+	void request(int tag, int cycles)
+	{
+		sh4_sched_request(ids[tag], cycles);
+		setDue(tag, cycles);
+	}
+
+	void setDue(int tag, int cycles)
+	{
+		events[tag].scheduled = cycles != -1;
+		events[tag].cycles = cycles;
+		events[tag].due = sh4_sched_now() + cycles;
+	}
+
+	static int callback(int tag, int cycles, int jitter)
+	{
+		return instance->onEvent(tag, cycles, jitter);
+	}
+
+	int onEvent(int tag, int cycles, int jitter)
+	{
+		dispatchCount++;
+		EXPECT_TRUE(events[tag].scheduled) << "event " << tag << " wasn't scheduled";
+		EXPECT_EQ(events[tag].cycles, cycles);
+		EXPECT_EQ(events[tag].due, sh4_sched_now() - jitter);
+		// Events are handled at the end of the tick they expire in, or the next one
+		// if they were scheduled during that tick after it handled them.
+		EXPECT_LE(0, jitter);
+		EXPECT_GE(SH4_TIMESLICE, jitter);
+		events[tag].scheduled = false;
+
+		u32 r = rng();
+		if (r % 8 == 0)
+		{
+			// reschedule or cancel another event
+			int other = (r >> 8) % ids.size();
+			request(other, (r >> 24) % 4 == 0 ? -1 : (int)((r >> 12) % 1000));
+		}
+		if (r % 64 == 1)
+			return 0;
+		int reSched = 1 + (r >> 4) % 5000;
+		// The scheduler compensates the jitter
+		setDue(tag, std::max(0, reSched - jitter));
+		return reSched;
+	}
+
+	static Workload *instance;
+	std::mt19937 rng{ 42 };
+	std::vector<int> ids;
+	std::vector<Event> events;
+	std::vector<sched_list> savedEvents;
+	u32 savedTime = 0;
+};
+Workload *Workload::instance;
+
+}
+
+class Sh4SchedTest : public ::testing::Test {
+protected:
+	void SetUp() override {
+		if (!_vmem_reserve())
+			die("_vmem_reserve failed");
+		dc_init();
+		dc_reset(true);
+	}
+};
+
+TEST_F(Sh4SchedTest, DispatchOnTime)
+{
+	Workload workload(24);
+	workload.run(SH4_MAIN_CLOCK / 10);
+	ASSERT_LT(1000u, workload.dispatchCount);
+	ASSERT_EQ(0, workload.overdue());
+}